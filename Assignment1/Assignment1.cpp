@@ -3,11 +3,15 @@
 
 #include "llvm/ADT/SCCIterator.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
+#include "ResultsStore.h"
+#include <chrono>
 #include <cxxabi.h>
 #include <iostream>
 #include <memory>
@@ -31,6 +35,17 @@ raw_string_ostream debug(debug_str);
 std::string output_str;
 raw_string_ostream output(output_str);
 
+// Results store shared by all runs, see ResultsStore.h
+static cl::opt<string> UndefResults("undeclvar-results", cl::init(""),
+                                    cl::desc("Append the results to this store"));
+
+// Per function budgets. When one is exceeded the remaining blocks are
+// analyzed with every variable possibly undefined. 0 means no limit.
+static cl::opt<unsigned> UndefTimeBudget("undeclvar-time-budget", cl::init(2000),
+                                         cl::desc("Milliseconds before the analysis degrades"));
+static cl::opt<unsigned> UndefMemoryBudget("undeclvar-memory-budget", cl::init(1024),
+                                           cl::desc("MB of exit sets before the analysis degrades"));
+
 // Demangles the function name.
 std::string demangle(const char *name) {
   int status = -1;
@@ -102,10 +117,20 @@ struct Assignment1 : public FunctionPass {
   // Keep track of all the functions we have encountered so far.
   unordered_map<string, bool> funcNames;
 
+  // Once degraded, one entrySet is shared by the remaining blocks and
+  // stores no longer remove variables from it.
+  bool degraded = false;
+  size_t trackedValues = 0;
+
+  // Results of the functions analyzed so far, for -undeclvar-results
+  results::Writer writer;
+
   // Reset all global variables when a new function is called.
   void cleanGlobalVariables() {
 
     BuggyLines.clear();
+    degraded = false;
+    trackedValues = 0;
     output_str = "";
     debug_str = "";
   }
@@ -139,7 +164,7 @@ struct Assignment1 : public FunctionPass {
         isBug = true;
       }
       // If value not in EntrySet and pointer in EntrySet, remove pointer from EntrySet
-      else if (entrySet.count(pointer)) {
+      else if (!degraded && entrySet.count(pointer)) {
         entrySet.erase(pointer);
       } 
     } 
@@ -162,6 +187,33 @@ struct Assignment1 : public FunctionPass {
     return;
   }
 
+  // The exceeded budget, empty if the analysis may go on
+  string checkBudgets(chrono::steady_clock::time_point start) {
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(
+        chrono::steady_clock::now() - start).count();
+    if (UndefTimeBudget && elapsed > UndefTimeBudget)
+      return "time budget of " + to_string(UndefTimeBudget) + " ms exceeded";
+    // A set node costs about 40 bytes with its bucket
+    if (UndefMemoryBudget && trackedValues * 40 > (size_t)UndefMemoryBudget << 20)
+      return "memory budget of " + to_string(UndefMemoryBudget) + " MB exceeded";
+    return "";
+  }
+
+  // Sound over-approximation once a budget is exceeded: everything any
+  // exitSet holds and every alloca of the function may be undefined in the
+  // blocks that are left, so each of their loads is reported.
+  void degrade(Function &F) {
+    degraded = true;
+    entrySet.clear();
+    for (auto &exitSet : exitSetMap)
+      entrySet.insert(exitSet.second.begin(), exitSet.second.end());
+    for (Instruction &I : instructions(F))
+      if (isa<AllocaInst>(&I))
+        entrySet.insert(&I);
+    exitSetMap.clear();
+    trackedValues = 0;
+  }
+
   // Function to return the line numbers that uses an undefined variable.
   bool runOnFunction(Function &F) override {
 
@@ -188,9 +240,24 @@ struct Assignment1 : public FunctionPass {
 
     // Clear exitSetMap at the start of function
     exitSetMap.clear();
+    auto start = chrono::steady_clock::now();
     
     // Iterate through basic blocks of the function.
     for (auto b : topoSortBBs(F)) {
+      if (!degraded) {
+        string overBudget = checkBudgets(start);
+        if (!overBudget.empty()) {
+          degrade(F);
+          output << "Degraded: " << funcName << ", " << overBudget
+                 << ", all variables possibly undefined\n";
+        }
+      }
+      if (degraded) {
+        for (BasicBlock::const_iterator It = b->begin(); It != b->end(); ++It)
+          checkUseBeforeDef(const_cast<llvm::Instruction *>(&*It), b);
+        continue;
+      }
+
       // EntrySet of a basic block is the union of all exitSets of the predecessors
       entrySet.clear();
       for (auto pred_it = pred_begin(b); pred_it != pred_end(b); ++ pred_it) {
@@ -206,6 +273,7 @@ struct Assignment1 : public FunctionPass {
       }
       
       // Save final entrySet into exitSetMap
+      trackedValues += entrySet.size();
       exitSetMap[b] = entrySet;
     }
 
@@ -218,10 +286,24 @@ struct Assignment1 : public FunctionPass {
     // Sort vector
     std::sort(temp.begin(), temp.end());
 
-    // // Print the source code line number(s).
-    // for (auto line : temp) {
-    //   output << funcName << " : " << line << "\n";
-    // }
+    // Print the source code line number(s).
+    for (auto line : temp) {
+      output << funcName << " : " << line << "\n";
+    }
+
+    if (!UndefResults.empty()) {
+      string fileName;
+      unsigned funcLine = 0;
+      if (DISubprogram *subprogram = F.getSubprogram()) {
+        fileName = subprogram->getFilename().str();
+        funcLine = subprogram->getLine();
+      }
+
+      // Recorded without uses too, so it supersedes older results
+      writer.analyzed(funcName, fileName, funcLine, results::UndefinedUse);
+      for (auto line : temp)
+        writer.add(results::UndefinedUse, funcName, fileName, line, "");
+    }
 
 // Print debug string if __DEBUG__ is enabled.
 #ifdef __DEBUG__
@@ -236,6 +318,14 @@ struct Assignment1 : public FunctionPass {
     cleanGlobalVariables();
     return false;
   }
+
+  // One segment with the results of all functions of the module
+  bool doFinalization(Module &M) override {
+    string error;
+    if (!UndefResults.empty() && !writer.empty() && !writer.append(UndefResults, error))
+      errs() << "Cannot write " << UndefResults << ": " << error << "\n";
+    return false;
+  }
 };
 } // namespace
 
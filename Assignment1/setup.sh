@@ -9,3 +9,4 @@ fi
 mkdir "$ASSIGNMENT_DIR"
 ln -s $(pwd)/$ASSIGNMENT.cpp $ASSIGNMENT_DIR/$ASSIGNMENT.cpp
 ln -s $(pwd)/CMakeLists.txt $ASSIGNMENT_DIR/CMakeLists.txt
+ln -s $(pwd)/../ResultsStore/ResultsStore.h $ASSIGNMENT_DIR/ResultsStore.h
@@ -5,11 +5,19 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/Dominators.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "ResultsStore.h"
+#include <chrono>
 #include <cxxabi.h>
 #include <iostream>
 #include <memory>
+#include <set>
 #include <string>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -29,6 +37,41 @@ raw_string_ostream debug(debug_str);
 std::string output_str;
 raw_string_ostream output(output_str);
 
+// Function to analyze. With -taint-directed its arguments are treated as
+// input, like cin.
+static cl::opt<string> TaintEntry("taint-entry", cl::init("main"),
+                                  cl::desc("Function to run the taint analysis on"));
+
+// Taint for directed fuzzing (taintdistance): the entry function's arguments
+// are input, taint flows through arithmetic, casts and address computations,
+// and a store into an element or field taints the whole object. Without it
+// only cin is input and taint only moves through loads, stores and calls.
+static cl::opt<bool> TaintDirected("taint-directed", cl::init(false),
+                                   cl::desc("Track taint for directed fuzzing"));
+
+// File that receives the input dependent branch and memory access sites,
+// one "file:line kind" per line, as targets for directed fuzzing.
+static cl::opt<string> TaintSinks("taint-sinks", cl::init(""),
+                                  cl::desc("Write tainted sites to this file"));
+
+// Results store shared by all runs, see ResultsStore.h. Every user defined
+// function is analyzed for it, not only the entry function.
+static cl::opt<string> TaintResults("taint-results", cl::init(""),
+                                    cl::desc("Append the results to this store"));
+
+// Iteration budget of the fixpoint, so that a solver regression fails the
+// regression tests instead of slowing them down. 0 means no limit.
+static cl::opt<unsigned> TaintMaxIterations("taint-max-iterations", cl::init(0),
+                                            cl::desc("Fail if the fixpoint needs more iterations"));
+
+// Per function budgets of the fixpoint. When one is exceeded the analysis
+// falls back to a flow insensitive taint set, see degrade(). 0 means no limit.
+static cl::opt<unsigned> TaintTimeBudget("taint-time-budget", cl::init(2000),
+                                         cl::desc("Milliseconds before the analysis degrades"));
+static cl::opt<unsigned> TaintIterationBudget("taint-iteration-budget", cl::init(1000),
+                                              cl::desc("Iterations before the analysis degrades"));
+static cl::opt<unsigned> TaintMemoryBudget("taint-memory-budget", cl::init(1024),
+                                           cl::desc("MB of entry/exit sets before the analysis degrades"));
 
 namespace {
 class Assignment2 : public FunctionPass {
@@ -44,9 +87,12 @@ public:
   }
 
   bool runOnFunction(Function &F) override {
-    // Only consider "main" function
+    // Only consider the entry function, "main" by default, or every user
+    // defined function when writing a results store
     string funcName = demangle(F.getName().str().c_str());
-    if (funcName != "main") {
+    bool isEntry = funcName == TaintEntry;
+    if (!isEntry && (TaintResults.empty() || funcName[0] == '_' ||
+                     funcName.find("std") != string::npos)) {
       return false;
     }
 
@@ -60,7 +106,8 @@ public:
 
     // Get user declared variables
     decVarSet.clear();
-    for (auto b : topoSortBBs(F)) {
+    vector<BasicBlock *> blocks = topoSortBBs(F);
+    for (auto b : blocks) {
       // Iterate over all the instructions within a basic block, get decVarSet. 
       for (BasicBlock::const_iterator It = b->begin(); It != b->end(); ++It) {
         Instruction *ins = const_cast<llvm::Instruction *>(&*It);
@@ -70,10 +117,25 @@ public:
     printSet(decVarSet);
     
     bool change = true;
+    unsigned iterations = 0;
+    start = chrono::steady_clock::now();
+    string overBudget;
     // Chaotic iteration, loop until all entrySet and exitSet don't change
-    while (change) {
+    while (change && overBudget.empty()) {
       change = false;
-      for (auto b : topoSortBBs(F)) {
+      iterations++;
+      if (TaintMaxIterations && iterations > TaintMaxIterations) {
+        errs() << "error: taint analysis of " << funcName << " did not converge in "
+               << TaintMaxIterations << " iterations\n";
+        exit(1);
+      }
+      // Sinks of the last iteration are the ones at the fixpoint
+      sinkSet.clear();
+      for (auto b : blocks) {
+        overBudget = checkBudgets(iterations);
+        if (!overBudget.empty()) {
+          break;
+        }
         taintSet.clear();
 
         // EntrySet of a basic block is the union of all exitSets of the predecessors
@@ -82,10 +144,17 @@ public:
           taintSet.insert(predExitSet.begin(), predExitSet.end());
         }
 
+        // Arguments of the entry function are input
+        if (TaintDirected && isEntry && b == &F.getEntryBlock()) {
+          for (Argument &arg : F.args()) {
+            taintSet.insert(&arg);
+          }
+        }
+
         // If entrySet is different from previous entrySet, set flag and update exitSetMap
         if (taintSet != entrySetMap[b]) {
           change = true;
-          entrySetMap[b] = taintSet;
+          updateSet(entrySetMap[b]);
         }
 
         // Iterate over all the instructions within a basic block, update taintSet. 
@@ -93,6 +162,7 @@ public:
           debug << "\n";
 
           Instruction *ins = const_cast<llvm::Instruction *>(&*It);
+          checkSink(ins);
           checkTainted(ins);
 
           ins->print(debug);
@@ -103,15 +173,29 @@ public:
         // If exitSet is different from previous exitSet, set flag and update exitSetMap
         if (taintSet != exitSetMap[b]) {
           change = true;
-          exitSetMap[b] = taintSet;
+          updateSet(exitSetMap[b]);
         }
       }
     }
 
+    if (!overBudget.empty()) {
+      string fallback = degrade(F, blocks);
+      output << "Degraded: " << funcName << ", " << overBudget << " after " << iterations
+             << " iterations, " << fallback << "\n";
+    }
+
     // Print final taintSet(exitSet)
     output << "Tainted: ";
     outputTaintSet();
 
+    if (!TaintSinks.empty() && isEntry) {
+      writeSinks();
+    }
+
+    if (!TaintResults.empty()) {
+      writeResults(F, funcName);
+    }
+
     // Print debug string if __DEBUG__ is enabled.
     #ifdef __DEBUG__
     errs() << debug.str();
@@ -126,6 +210,14 @@ public:
     return false;
   }
 
+  // One segment with the results of all functions of the module
+  bool doFinalization(Module &M) override {
+    string error;
+    if (!TaintResults.empty() && !writer.empty() && !writer.append(TaintResults, error)) {
+      errs() << "Cannot write " << TaintResults << ": " << error << "\n";
+    }
+    return false;
+  }
 
 private:
   unordered_set<Value *> taintSet;
@@ -133,6 +225,17 @@ private:
   unordered_map<BasicBlock *, unordered_set<Value *>> entrySetMap;
   unordered_map<BasicBlock *, unordered_set<Value *>> exitSetMap;
   unordered_set<BasicBlock *> straightLineBBs;
+  // Budget state of the current function
+  chrono::steady_clock::time_point start;
+  size_t trackedValues = 0;
+  bool degraded = false;
+
+  // file, line, kind, callee for "call" sites
+  set<tuple<string, unsigned, string, string>> sinkSet;
+  // Results of the functions analyzed so far, for -taint-results
+  results::Writer writer;
+  // Messages already printed, every iteration revisits the same lines
+  set<string> printedLines;
 
   // Check tainted and untainted variables on each instruction
   void checkTainted(Instruction *I) {
@@ -152,7 +255,7 @@ private:
         bool tainted = false;
         for (auto argIt = callInst->arg_begin(); argIt != callInst->arg_end(); ++argIt) {
           Value *arg = *argIt;
-          if (isInTaintSet(arg)) {
+          if (isTaintedOperand(arg)) {
             tainted = true;
             break;
           }
@@ -179,11 +282,18 @@ private:
       Value *pointer = storeInst->getPointerOperand();
 
       // 3. Assign a var to another var
-      if (isInTaintSet(value)) {
+      if (isTaintedOperand(value)) {
         // Variable is tainted if assigned by a tainted var
         debug << "-------------Assigned variable " << pointer->getName() << " tainted by " << value->getName() << "-------------\n";
         printTaintedLine(pointer, I);
         taintSet.insert(pointer);
+
+        // Storing into an element or field taints the whole object
+        Value *object = getPointedObject(pointer);
+        if (TaintDirected && object != pointer) {
+          printTaintedLine(object, I);
+          taintSet.insert(object);
+        }
       } else if (isStraightLine(storeInst)) {
         // Variable is untainted if assigned by an untainted var and in straight line code
         debug << "-------------Assigned variable " << pointer->getName() << " untainted by " << value->getName() << "-------------\n";
@@ -197,7 +307,7 @@ private:
       Value *pointer = loadIns->getPointerOperand();
 
       // 4. Load from var to another var
-      if (isInTaintSet(pointer)) {
+      if (isTaintedOperand(pointer)) {
         // Variable is tainted if loaded from a tainted var
         debug << "-------------Loaded variable " << loadIns->getName() << " tainted by " << pointer->getName() << "-------------\n";
         printTaintedLine(loadIns, I);
@@ -217,6 +327,141 @@ private:
     return taintSet.find(variable) != taintSet.end();
   }
 
+  // Operand of a load, store or call. Only -taint-directed looks through the
+  // computations in between.
+  bool isTaintedOperand(Value *value) {
+    return TaintDirected ? isTainted(value) : isInTaintSet(value);
+  }
+
+  // A value is tainted if it is in the taintSet or is computed from a tainted
+  // value by arithmetic, casts, compares or address computations. Sites are
+  // always found this way, a branch condition is never in the taintSet.
+  bool isTainted(Value *value) {
+    unordered_set<Value *> visited;
+    return isTainted(value, visited);
+  }
+
+  bool isTainted(Value *value, unordered_set<Value *> &visited) {
+    if (isInTaintSet(value)) {
+      return true;
+    }
+    Instruction *I = dyn_cast<Instruction>(value);
+    if (!I || isa<LoadInst>(I) || isa<CallInst>(I) || isa<AllocaInst>(I) ||
+        !visited.insert(I).second) {
+      return false;
+    }
+    for (Value *operand : I->operands()) {
+      if (isTainted(operand, visited)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Get the variable holding the object a pointer points into: the array
+  // for &a[i], or the pointer variable p for &p->field.
+  Value *getPointedObject(Value *pointer) {
+    Value *base = pointer->stripInBoundsOffsets();
+    if (LoadInst *loadInst = dyn_cast<LoadInst>(base)) {
+      return loadInst->getPointerOperand();
+    }
+    return base;
+  }
+
+  // Record branches and memory accesses whose condition, address or size
+  // depends on input.
+  void checkSink(Instruction *I) {
+    string kind, calleeName;
+    if (BranchInst *brInst = dyn_cast<BranchInst>(I)) {
+      if (brInst->isConditional() && isTainted(brInst->getCondition())) {
+        kind = "branch";
+      }
+    } else if (SwitchInst *switchInst = dyn_cast<SwitchInst>(I)) {
+      if (isTainted(switchInst->getCondition())) {
+        kind = "branch";
+      }
+    } else if (LoadInst *loadInst = dyn_cast<LoadInst>(I)) {
+      if (hasTaintedIndex(loadInst->getPointerOperand())) {
+        kind = "load";
+      }
+    } else if (StoreInst *storeInst = dyn_cast<StoreInst>(I)) {
+      if (hasTaintedIndex(storeInst->getPointerOperand())) {
+        kind = "store";
+      }
+    } else if (MemIntrinsic *memInst = dyn_cast<MemIntrinsic>(I)) {
+      if (isTainted(memInst->getLength())) {
+        kind = "memory";
+      }
+    } else if (CallInst *callInst = dyn_cast<CallInst>(I)) {
+      // Tainted argument passed to a call, except the cin input itself
+      Function *callee = callInst->getCalledFunction();
+      if (callee && !isa<IntrinsicInst>(callInst) &&
+          callInst->getOperand(0)->getName().str().find("cin") == string::npos) {
+        for (Value *arg : callInst->args()) {
+          if (isTainted(arg)) {
+            kind = "call";
+            calleeName = demangle(callee->getName().str().c_str());
+            break;
+          }
+        }
+      }
+    }
+
+    DILocation *loc = I->getDebugLoc();
+    if (!kind.empty() && loc) {
+      sinkSet.insert(make_tuple(loc->getFilename().str(), loc->getLine(), kind, calleeName));
+    }
+  }
+
+  bool hasTaintedIndex(Value *pointer) {
+    GetElementPtrInst *gep = dyn_cast<GetElementPtrInst>(pointer);
+    if (!gep) {
+      return false;
+    }
+    for (auto idx = gep->idx_begin(); idx != gep->idx_end(); ++idx) {
+      if (!isa<Constant>(*idx) && isTainted(*idx)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void writeSinks() {
+    std::error_code EC;
+    raw_fd_ostream file(TaintSinks, EC, sys::fs::OF_Text);
+    if (EC) {
+      errs() << "Cannot write " << TaintSinks << ": " << EC.message() << "\n";
+      return;
+    }
+    for (auto &sink : sinkSet) {
+      file << get<0>(sink) << ":" << get<1>(sink) << " " << get<2>(sink) << "\n";
+    }
+  }
+
+  // Tainted variables at the exit of the function, sinks and tainted calls
+  void writeResults(Function &F, const string &funcName) {
+    string fileName;
+    unsigned line = 0;
+    if (DISubprogram *subprogram = F.getSubprogram()) {
+      fileName = subprogram->getFilename().str();
+      line = subprogram->getLine();
+    }
+
+    writer.analyzed(funcName, fileName, line, results::Tainted);
+    for (Value *element : taintSet) {
+      if (isInDecVarSet(element)) {
+        writer.add(results::Tainted, funcName, fileName, line, element->getName().str());
+      }
+    }
+    for (auto &sink : sinkSet) {
+      if (get<2>(sink) == "call") {
+        writer.add(results::TaintedCall, funcName, get<0>(sink), get<1>(sink), get<3>(sink));
+      } else {
+        writer.add(results::TaintSink, funcName, get<0>(sink), get<1>(sink), get<2>(sink));
+      }
+    }
+  }
+
   bool hasTaintedArgument(Function *calledFunction) {
     for (auto arg = calledFunction->arg_begin(); arg != calledFunction->arg_end(); ++arg) {
       Value *argument = &(*arg);
@@ -229,30 +474,42 @@ private:
     return false;
   }
 
+  // Print the variables sorted by name, so the output is deterministic
   void outputTaintSet() {
-    output << "{";
-    bool first = true;
+    set<string> names;
     for (Value *element : taintSet) {
       if (isInDecVarSet(element)) {
-        if (!first) {
-          output << ",";
-        }
-        output << element->getName();
-        first = false;
+        names.insert(element->getName().str());
+      }
+    }
+
+    output << "{";
+    bool first = true;
+    for (const string &name : names) {
+      if (!first) {
+        output << ",";
       }
+      output << name;
+      first = false;
     }
     output << "}\n\n";
   }
 
   void printTaintedLine(Value *var, Instruction *I) {
     if (isInDecVarSet(var) && !isInTaintSet(var)) {
-      output << "Line " << getSourceCodeLine(I) << ": " << var->getName() << " is tainted\n";
+      printLine("Line " + to_string(getSourceCodeLine(I)) + ": " + var->getName().str() + " is tainted\n");
     }
   }
 
   void printUntaintedLine(Value *var, Instruction *I) {
     if (isInDecVarSet(var) && isInTaintSet(var)) {
-      output << "Line " << getSourceCodeLine(I) << ": " << var->getName() << " is now untainted\n";
+      printLine("Line " + to_string(getSourceCodeLine(I)) + ": " + var->getName().str() + " is now untainted\n");
+    }
+  }
+
+  void printLine(const string &line) {
+    if (printedLines.insert(line).second) {
+      output << line;
     }
   }
 
@@ -321,13 +578,95 @@ private:
   }
 
   // Check if an instruction is straight line
+  // Nothing is straight line, so nothing is untainted, once degraded
   bool isStraightLine(Instruction *I) {
     BasicBlock* block = I->getParent();
-    return straightLineBBs.count(block);
+    return !degraded && straightLineBBs.count(block);
+  }
+
+  // Save taintSet in an entry/exit set, counting the tracked values
+  void updateSet(unordered_set<Value *> &saved) {
+    trackedValues += taintSet.size();
+    trackedValues -= saved.size();
+    saved = taintSet;
+  }
+
+  long elapsedMs() {
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+  }
+
+  // The exceeded budget, empty if the fixpoint may go on
+  string checkBudgets(unsigned iterations) {
+    if (TaintTimeBudget && elapsedMs() > TaintTimeBudget) {
+      return "time budget of " + to_string(TaintTimeBudget) + " ms exceeded";
+    }
+    if (TaintIterationBudget && iterations > TaintIterationBudget) {
+      return "iteration budget of " + to_string(TaintIterationBudget) + " exceeded";
+    }
+    // A set node costs about 40 bytes with its bucket
+    if (TaintMemoryBudget && trackedValues * 40 > (size_t)TaintMemoryBudget << 20) {
+      return "memory budget of " + to_string(TaintMemoryBudget) + " MB exceeded";
+    }
+    return "";
+  }
+
+  // Sound over-approximation once a budget is exceeded. A value tainted
+  // anywhere is tainted everywhere: one taint set for the whole function,
+  // grown over all blocks until it stops changing, and no untainting. If
+  // that takes another time budget too, every variable is tainted.
+  string degrade(Function &F, vector<BasicBlock *> &blocks) {
+    degraded = true;
+    taintSet.clear();
+    if (TaintDirected && demangle(F.getName().str().c_str()) == TaintEntry) {
+      for (Argument &arg : F.args()) {
+        taintSet.insert(&arg);
+      }
+    }
+    for (auto &exitSet : exitSetMap) {
+      taintSet.insert(exitSet.second.begin(), exitSet.second.end());
+    }
+    entrySetMap.clear();
+    exitSetMap.clear();
+    trackedValues = 0;
+
+    start = chrono::steady_clock::now();
+    size_t before;
+    do {
+      if (TaintTimeBudget && elapsedMs() > TaintTimeBudget) {
+        taintSet.insert(decVarSet.begin(), decVarSet.end());
+        for (auto b : blocks) {
+          for (Instruction &I : *b) {
+            taintSet.insert(&I);
+          }
+        }
+        sinkSet.clear();
+        for (auto b : blocks) {
+          for (Instruction &I : *b) {
+            checkSink(&I);
+          }
+        }
+        return "all variables tainted";
+      }
+
+      before = taintSet.size();
+      sinkSet.clear();
+      for (auto b : blocks) {
+        for (Instruction &I : *b) {
+          checkSink(&I);
+          checkTainted(&I);
+        }
+      }
+    } while (taintSet.size() != before);
+    return "taint is flow insensitive";
   }
 
   // Reset all global variables when a new function is called.
   void cleanGlobalVariables() {
+    entrySetMap.clear();
+    exitSetMap.clear();
+    trackedValues = 0;
+    degraded = false;
+    printedLines.clear();
     output_str = "";
     debug_str = "";
   }
@@ -15,4 +15,17 @@ int main() {
   }             // Tainted = {x}
   cout << z;    // Tainted = {x,z}
   return 0;     // Tainted = {x,z}
-}
\ No newline at end of file
+}
+
+// -undeclvar does not see cin >> x as a definition of x.
+// RUN: %clangxx -O0 -g -S -emit-llvm -fno-discard-value-names -o %t.ll -c %s
+// RUN: timeout 10 %opt -enable-new-pm=0 -load %assignment2 -taintanalysis -taint-max-iterations=2 -disable-output %t.ll 2>&1 | FileCheck %s
+// RUN: timeout 10 %opt -enable-new-pm=0 -load %assignment1 -undeclvar -disable-output %t.ll 2>&1 | FileCheck --allow-empty --check-prefix=UNDEF %s
+
+// CHECK: Line 8: x is tainted
+// CHECK-NEXT: Line 12: z is tainted
+// CHECK-NEXT: Tainted: {x,z}
+// UNDEF: main : 11
+// UNDEF-NEXT: main : 12
+// UNDEF-NEXT: main : 16
+// UNDEF-NOT: main :
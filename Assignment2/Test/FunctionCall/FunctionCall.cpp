@@ -14,4 +14,16 @@ int main() {
   cout << z;              //Tainted = {x,z}
   z = 3;                  //Tainted = {x}
   return 0;               //Tainted = {x}
-}
\ No newline at end of file
+}
+
+// -undeclvar does not see cin >> x as a definition of x.
+// RUN: %clangxx -O0 -g -S -emit-llvm -fno-discard-value-names -o %t.ll -c %s
+// RUN: timeout 10 %opt -enable-new-pm=0 -load %assignment2 -taintanalysis -taint-max-iterations=2 -disable-output %t.ll 2>&1 | FileCheck %s
+// RUN: timeout 10 %opt -enable-new-pm=0 -load %assignment1 -undeclvar -disable-output %t.ll 2>&1 | FileCheck --allow-empty --check-prefix=UNDEF %s
+
+// CHECK: Line 11: x is tainted
+// CHECK-NEXT: Line 13: z is tainted
+// CHECK-NEXT: Line 15: z is now untainted
+// CHECK-NEXT: Tainted: {x}
+// UNDEF: main : 13
+// UNDEF-NOT: main :
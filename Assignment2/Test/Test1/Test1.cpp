@@ -14,4 +14,12 @@ int main() {
     x = 1;                //Tainted = {x}
   }
   return 0;               //Tainted = {x}
-}
\ No newline at end of file
+}
+
+// RUN: %clangxx -O0 -g -S -emit-llvm -fno-discard-value-names -o %t.ll -c %s
+// RUN: timeout 10 %opt -enable-new-pm=0 -load %assignment2 -taintanalysis -taint-max-iterations=2 -disable-output %t.ll 2>&1 | FileCheck %s
+// RUN: timeout 10 %opt -enable-new-pm=0 -load %assignment1 -undeclvar -disable-output %t.ll 2>&1 | FileCheck --allow-empty --check-prefix=UNDEF %s
+
+// CHECK: Line 10: x is tainted
+// CHECK-NEXT: Tainted: {x}
+// UNDEF-NOT: main :
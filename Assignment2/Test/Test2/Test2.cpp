@@ -22,4 +22,15 @@ int main() {
   cin >> a;
   a = multi_func(x, y, z);
   return 0;               //Tainted = {}
-}
\ No newline at end of file
+}
+
+// RUN: %clangxx -O0 -g -S -emit-llvm -fno-discard-value-names -o %t.ll -c %s
+// RUN: timeout 10 %opt -enable-new-pm=0 -load %assignment2 -taintanalysis -taint-max-iterations=2 -disable-output %t.ll 2>&1 | FileCheck %s
+// RUN: timeout 10 %opt -enable-new-pm=0 -load %assignment1 -undeclvar -disable-output %t.ll 2>&1 | FileCheck --allow-empty --check-prefix=UNDEF %s
+
+// CHECK: Line 19: z is tainted
+// CHECK-NEXT: Line 20: z is now untainted
+// CHECK-NEXT: Line 22: a is tainted
+// CHECK-NEXT: Line 23: a is now untainted
+// CHECK-NEXT: Tainted: {}
+// UNDEF-NOT: main :
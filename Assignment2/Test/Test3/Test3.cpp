@@ -15,4 +15,16 @@ int main() {
   }
 
   return 0;               // Tainted = {x, y}
-}
\ No newline at end of file
+}
+
+// The loop needs more iterations than straight line code.
+// RUN: %clangxx -O0 -g -S -emit-llvm -fno-discard-value-names -o %t.ll -c %s
+// RUN: timeout 10 %opt -enable-new-pm=0 -load %assignment2 -taintanalysis -taint-max-iterations=4 -disable-output %t.ll 2>&1 | FileCheck %s
+// RUN: timeout 10 %opt -enable-new-pm=0 -load %assignment1 -undeclvar -disable-output %t.ll 2>&1 | FileCheck --allow-empty --check-prefix=UNDEF %s
+
+// CHECK: Line 9: x is tainted
+// CHECK-NEXT: Line 14: y is tainted
+// CHECK-NEXT: Tainted: {x,y}
+// UNDEF: main : 12
+// UNDEF-NEXT: main : 13
+// UNDEF-NOT: main :
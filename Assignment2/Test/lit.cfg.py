@@ -0,0 +1,28 @@
+# lit configuration of the regression tests: every case is compiled and run
+# through -taintanalysis and -undeclvar, and the output is checked against the
+# CHECK (taint) and UNDEF (undefined variables) lines at the end of the file.
+# Each RUN line has a wall-clock budget (timeout) and the taint analysis a
+# fixpoint iteration budget (-taint-max-iterations), so a solver that gets
+# slower fails like a wrong result does.
+#
+# Run with ../test.sh, or ninja check-assignment2 in the LLVM build directory.
+
+import os
+
+import lit.formats
+
+config.name = 'Assignment2'
+config.test_format = lit.formats.ShTest(execute_external=True)
+config.suffixes = ['.cpp']
+config.test_source_root = os.path.dirname(__file__)
+
+llvm_build = lit_config.params.get('llvm_build',
+                                   os.path.expanduser('~/llvm-project/build'))
+config.environment['PATH'] = os.pathsep.join(
+    [os.path.join(llvm_build, 'bin'), config.environment['PATH']])
+
+config.substitutions.append(('%clangxx', 'clang++'))
+config.substitutions.append(('%opt', 'opt'))
+for plugin in ['Assignment1', 'Assignment2']:
+    config.substitutions.append(
+        ('%' + plugin.lower(), os.path.join(llvm_build, 'lib', plugin + '.so')))
@@ -0,0 +1,4 @@
+#!/bin/bash
+# Run the regression tests in Test/ in parallel, one lit worker per core.
+# Extra arguments go to lit, e.g. ./test.sh --filter Test3
+~/llvm-project/build/bin/llvm-lit -sv "$(dirname "$0")/Test" "$@"
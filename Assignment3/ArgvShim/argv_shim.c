@@ -0,0 +1,160 @@
+// Preloadable shim that runs an unmodified main(argc, argv) target as an AFL++
+// persistent, shared-memory fuzzing harness.
+//
+// Build the target with ./build.sh and fuzz it with
+//   AFL_PRELOAD=./argv_shim.so AFL_PERSISTENT=1 AFL_DEFER_FORKSRV=1
+//     afl-fuzz -i in -o out -- ./target [fixed args]
+// (no @@). The shim takes over __libc_start_main and then, instead of calling
+// main once:
+//   - turns on shared-memory test cases and starts the fork server itself,
+//   - loops in __afl_persistent_loop, and every iteration restores the
+//     target's globals from a snapshot taken before the first run, rebuilds
+//     argv as the fixed arguments followed by the test case, and calls main.
+// The test case is one argument by default; with ARGV_SHIM_SPLIT=1 it is
+// split at NUL bytes into several, like AFL's argv-fuzz-inl.h. Without an
+// AFL runtime (e.g. ./target < crash) the test case is read from stdin and
+// main runs once.
+//
+// build.sh links the target with -rdynamic, so the AFL runtime symbols can be
+// found with dlsym, and moves the target's .data and .bss into the
+// argv_shim_* sections, so the snapshot covers the target's globals (and
+// function statics) but not the AFL runtime's own state.
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_INPUT (1024 * 1024)
+#define MAX_ARGS 256
+#define LOOP_COUNT 10000
+
+typedef int (*main_fn)(int, char **, char **);
+typedef int (*libc_start_main_fn)(main_fn, int, char **, void (*)(void),
+                                  void (*)(void), void (*)(void), void *);
+
+static main_fn real_main;
+
+// AFL++ runtime, present when the target is built with afl-clang-fast
+static int (*afl_persistent_loop)(unsigned int);
+static void (*afl_manual_init)(void);
+static unsigned char **afl_fuzz_ptr;
+static unsigned int **afl_fuzz_len;
+
+typedef struct {
+  char *start;
+  char *stop;
+  char *snapshot;
+} Region;
+
+static const char *region_names[] = {"argv_shim_data", "argv_shim_rel", "argv_shim_bss"};
+static Region regions[3];
+
+static char input[MAX_INPUT + 1];
+static char *args[MAX_ARGS + 1];
+
+static void snapshot_globals(void) {
+  char name[64];
+
+  for (int i = 0; i < 3; i++) {
+    Region *r = &regions[i];
+    snprintf(name, sizeof(name), "__start_%s", region_names[i]);
+    r->start = dlsym(RTLD_DEFAULT, name);
+    snprintf(name, sizeof(name), "__stop_%s", region_names[i]);
+    r->stop = dlsym(RTLD_DEFAULT, name);
+    if (!r->start || !r->stop || r->stop <= r->start) {
+      r->start = r->stop = NULL;
+      continue;
+    }
+    r->snapshot = malloc(r->stop - r->start);
+    if (!r->snapshot) {
+      r->start = r->stop = NULL;
+      continue;
+    }
+    memcpy(r->snapshot, r->start, r->stop - r->start);
+  }
+}
+
+static void restore_globals(void) {
+  for (int i = 0; i < 3; i++) {
+    if (regions[i].start)
+      memcpy(regions[i].start, regions[i].snapshot, regions[i].stop - regions[i].start);
+  }
+}
+
+static unsigned int read_testcase(void) {
+  unsigned int len;
+
+  if (afl_fuzz_ptr && *afl_fuzz_ptr) {
+    len = **afl_fuzz_len;
+    if (len > MAX_INPUT)
+      len = MAX_INPUT;
+    memcpy(input, *afl_fuzz_ptr, len);
+  } else {
+    ssize_t n = read(0, input, MAX_INPUT);
+    len = n < 0 ? 0 : n;
+  }
+  input[len] = '\0';
+  return len;
+}
+
+// argv = fixed arguments from the command line, then the test case
+static int build_argv(int argc, char **argv, unsigned int len) {
+  int n = 0;
+
+  for (int i = 0; i < argc && n < MAX_ARGS; i++)
+    args[n++] = argv[i];
+
+  if (getenv("ARGV_SHIM_SPLIT")) {
+    // One argument per NUL terminated string, an empty one ends the list
+    char *p = input;
+    while (p < input + len && *p && n < MAX_ARGS) {
+      args[n++] = p;
+      p += strlen(p) + 1;
+    }
+  } else if (n < MAX_ARGS) {
+    args[n++] = input;
+  }
+  args[n] = NULL;
+  return n;
+}
+
+static int shim_main(int argc, char **argv, char **envp) {
+  afl_persistent_loop = dlsym(RTLD_DEFAULT, "__afl_persistent_loop");
+  afl_manual_init = dlsym(RTLD_DEFAULT, "__afl_manual_init");
+  afl_fuzz_ptr = dlsym(RTLD_DEFAULT, "__afl_fuzz_ptr");
+  afl_fuzz_len = dlsym(RTLD_DEFAULT, "__afl_fuzz_len");
+  int *sharedmem_fuzzing = dlsym(RTLD_DEFAULT, "__afl_sharedmem_fuzzing");
+
+  snapshot_globals();
+
+  // Ask for shared-memory test cases in the fork server handshake
+  if (sharedmem_fuzzing && afl_fuzz_ptr && afl_fuzz_len)
+    *sharedmem_fuzzing = 1;
+  if (afl_manual_init)
+    afl_manual_init();
+
+  int ret = 0;
+  int first = 1;
+  while (afl_persistent_loop ? afl_persistent_loop(LOOP_COUNT) : first) {
+    if (!first)
+      restore_globals();
+    first = 0;
+
+    unsigned int len = read_testcase();
+    int n = build_argv(argc, argv, len);
+    ret = real_main(n, args, envp);
+  }
+  return ret;
+}
+
+int __libc_start_main(main_fn main, int argc, char **argv, void (*init)(void),
+                      void (*fini)(void), void (*rtld_fini)(void), void *stack_end) {
+  libc_start_main_fn next = (libc_start_main_fn)dlsym(RTLD_NEXT, "__libc_start_main");
+
+  real_main = main;
+  return next(shim_main, argc, argv, init, fini, rtld_fini, stack_end);
+}
@@ -0,0 +1,52 @@
+#!/bin/bash
+# Build an argv-based target for argv_shim.so, without changing its source.
+# Usage: ./build.sh <output> <sources and compiler flags>...
+#   ./build.sh AFL1 ../PasswordCheck/AFL1.c
+# Sources may also be LLVM IR (.ll/.bc), e.g. the output of a pass.
+# C sources are compiled with $CC (afl-clang-fast by default), C++ sources
+# with $CXX (afl-clang-fast++), and the target is linked with -rdynamic by
+# $CXX if it has any C++ source, by $CC otherwise. Its .data and .bss
+# sections are renamed so the shim can find and restore the globals.
+out=$1
+shift
+CC=${CC:-afl-clang-fast}
+CXX=${CXX:-afl-clang-fast++}
+build="build_$(basename "$out")"
+mkdir -p "$build"
+
+# The shim itself is not instrumented
+${SHIM_CC:-clang} -O2 -g -fPIC -shared argv_shim.c -o argv_shim.so -ldl
+
+objs=()
+flags=()
+linker=$CC
+for arg in "$@"; do
+  case "$arg" in
+    *.c|*.cc|*.cpp|*.cxx|*.ll|*.bc) ;;
+    *.o|*.a) objs+=("$arg") ;;
+    *) flags+=("$arg") ;;
+  esac
+done
+for src in "$@"; do
+  case "$src" in
+    *.c|*.cc|*.cpp|*.cxx|*.ll|*.bc)
+      compiler=$CC
+      case "$src" in
+        *.cc|*.cpp|*.cxx) compiler=$CXX; linker=$CXX ;;
+      esac
+      obj="$build/$(basename "${src%.*}").o"
+      "$compiler" -O2 -g -fno-common "${flags[@]}" -c "$src" -o "$obj" || exit 1
+      objcopy --rename-section .data=argv_shim_data \
+              --rename-section .data.rel.local=argv_shim_rel \
+              --rename-section .bss=argv_shim_bss "$obj" || exit 1
+      objs+=("$obj")
+      ;;
+  esac
+done
+
+# The linker defines __start_/__stop_ of a section only if they are referenced
+bounds=()
+for section in argv_shim_data argv_shim_rel argv_shim_bss; do
+  bounds+=("-Wl,-u,__start_$section" "-Wl,-u,__stop_$section")
+done
+"$linker" -rdynamic "${bounds[@]}" "${objs[@]}" "${flags[@]}" -o "$out"
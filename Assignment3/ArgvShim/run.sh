@@ -0,0 +1,8 @@
+#!/bin/bash
+# Fuzz an argv-based target built by build.sh in persistent shared-memory mode.
+# Usage: ./run.sh <target> <input dir> [fixed args]
+target=$1
+inputs=$2
+shift 2
+AFL_PRELOAD=./argv_shim.so AFL_PERSISTENT=1 AFL_DEFER_FORKSRV=1 \
+  afl-fuzz -i "$inputs" -o "output_$(basename "$target")" -- "./$target" "$@"
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+# Fuzzer throughput benchmark across harness modes.
+#
+# Builds every Vulnerable harness in every execution mode (fork per exec,
+# forkserver, persistent, shared-memory test cases), fuzzes each one with the
+# same corpus for the same time, and records execs/s, stability, peak RSS and
+# time to first crash in results/results.csv. The plot_data of every run is
+# kept next to it for plot.py.
+#
+# Usage: ./bench.py [--seconds 60] [--corpus ../Vulnerable/shared_memory/input]
+
+import argparse
+import csv
+import os
+import re
+import shutil
+import subprocess
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+TARGETS = {
+    'original': '../Vulnerable/original/Vulnerable.c',
+    'fix_1': '../Vulnerable/fix_1/AFL2.c',
+    'shared_memory': '../Vulnerable/shared_memory/AFL2.c',
+}
+
+# mode: (BENCH_MODE, extra environment, input delivered through @@)
+MODES = {
+    'fork': (0, {'AFL_NO_FORKSRV': '1'}, True),
+    'forkserver': (0, {}, True),
+    'persistent': (1, {}, True),
+    'shmem': (2, {}, False),
+}
+
+FIELDS = ['target', 'mode', 'execs_per_sec', 'stability', 'peak_rss_mb',
+          'first_crash_ms', 'execs_done', 'unique_crashes']
+
+
+def build(target, source, mode):
+    binary = os.path.join(HERE, 'build', f'{target}-{mode}')
+    obj = os.path.join(HERE, 'build', f'{target}.o')
+    os.makedirs(os.path.dirname(binary), exist_ok=True)
+    subprocess.run(['afl-clang-fast', '-O2', '-g', '-include',
+                    os.path.join(HERE, '../Minimize/harness.h'), '-c',
+                    os.path.join(HERE, source), '-o', obj], check=True)
+    subprocess.run(['afl-clang-fast', '-O2', '-g',
+                    f'-DBENCH_MODE={MODES[mode][0]}',
+                    os.path.join(HERE, 'bench_main.c'), obj, '-o', binary],
+                   check=True)
+    return binary
+
+
+def read_stats(path):
+    stats = {}
+    with open(path) as f:
+        for line in f:
+            key, _, value = line.partition(':')
+            stats[key.strip()] = value.strip()
+    return stats
+
+
+def first_crash_ms(crash_dir):
+    times = []
+    if os.path.isdir(crash_dir):
+        for name in os.listdir(crash_dir):
+            match = re.search(r'time:(\d+)', name)
+            if match:
+                times.append(int(match.group(1)))
+    return min(times) if times else ''
+
+
+def fuzz(target, mode, binary, corpus, seconds):
+    out = os.path.join(HERE, 'build', f'output-{target}-{mode}')
+    shutil.rmtree(out, ignore_errors=True)
+
+    env = dict(os.environ, AFL_NO_UI='1', AFL_SKIP_CPUFREQ='1',
+               AFL_SKIP_CRASHES='1',
+               AFL_I_DONT_CARE_ABOUT_MISSING_CRASHES='1')
+    env.update(MODES[mode][1])
+    cmd = ['afl-fuzz', '-i', corpus, '-o', out, '-V', str(seconds),
+           '-m', 'none', '--', binary]
+    if MODES[mode][2]:
+        cmd.append('@@')
+    subprocess.run(cmd, env=env, stdout=subprocess.DEVNULL, check=True)
+
+    stats = read_stats(os.path.join(out, 'default', 'fuzzer_stats'))
+    shutil.copy(os.path.join(out, 'default', 'plot_data'),
+                os.path.join(HERE, 'results', f'{target}-{mode}.plot_data'))
+    return {
+        'target': target,
+        'mode': mode,
+        'execs_per_sec': stats.get('execs_per_sec', ''),
+        'stability': stats.get('stability', '').rstrip('%'),
+        'peak_rss_mb': stats.get('peak_rss_mb', ''),
+        'first_crash_ms': first_crash_ms(os.path.join(out, 'default', 'crashes')),
+        'execs_done': stats.get('execs_done', ''),
+        'unique_crashes': stats.get('saved_crashes', stats.get('unique_crashes', '')),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--seconds', type=int, default=60)
+    parser.add_argument('--corpus', default='../Vulnerable/shared_memory/input')
+    args = parser.parse_args()
+    corpus = os.path.join(HERE, args.corpus)
+
+    os.makedirs(os.path.join(HERE, 'results'), exist_ok=True)
+    rows = []
+    for target, source in TARGETS.items():
+        for mode in MODES:
+            binary = build(target, source, mode)
+            rows.append(fuzz(target, mode, binary, corpus, args.seconds))
+            print(f"{target:14} {mode:11} {rows[-1]['execs_per_sec']:>10} execs/s")
+
+    with open(os.path.join(HERE, 'results', 'results.csv'), 'w', newline='') as f:
+        writer = csv.DictWriter(f, fieldnames=FIELDS)
+        writer.writeheader()
+        writer.writerows(rows)
+
+
+if __name__ == '__main__':
+    main()
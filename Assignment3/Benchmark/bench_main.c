@@ -0,0 +1,85 @@
+// Benchmark driver: runs a fuzz target in one AFL execution mode.
+//
+// The target is compiled with -include ../Minimize/harness.h, which renames
+// its main to harness_main and turns its own persistent loop into a single
+// iteration, so the same target source can be driven in every mode:
+//   BENCH_MODE 0  one execution per process (fork per exec or forkserver,
+//                 chosen by AFL_NO_FORKSRV at fuzz time), input from @@
+//   BENCH_MODE 1  persistent loop, input re-read from @@ every iteration
+//   BENCH_MODE 2  persistent loop with shared-memory test cases
+// The input is passed both as argv[1] and as the shared-memory buffer, so
+// argv-based and shared-memory targets work unchanged.
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef BENCH_MODE
+#define BENCH_MODE 0
+#endif
+
+#define MAX_INPUT (1024 * 1024)
+
+// The target's main, either `int main()` or `int main(int, char **)`. Its
+// return value is undefined unless the target returns explicitly, see harness.h.
+int harness_main();
+
+// Runtime behind the macros in harness.h.
+unsigned char *minimize_testcase_buf;
+unsigned int minimize_testcase_len;
+static unsigned int loop_left;
+
+int minimize_loop(unsigned int max_cnt) {
+  (void)max_cnt;
+  if (!loop_left)
+    return 0;
+  loop_left--;
+  return 1;
+}
+
+static unsigned char input[MAX_INPUT + 1];
+
+static void run(char *prog, unsigned int len) {
+  char *argv[] = {prog, (char *)input, NULL};
+
+  input[len] = '\0';
+  minimize_testcase_buf = input;
+  minimize_testcase_len = len;
+  loop_left = 1;
+  harness_main(2, argv);
+}
+
+static unsigned int read_input(const char *path) {
+  FILE *f = path ? fopen(path, "rb") : NULL;
+  unsigned int len = 0;
+
+  if (f) {
+    len = fread(input, 1, MAX_INPUT, f);
+    fclose(f);
+  }
+  return len;
+}
+
+#if BENCH_MODE == 2
+__AFL_FUZZ_INIT();
+#endif
+
+int main(int argc, char **argv) {
+#if BENCH_MODE == 2
+  __AFL_INIT();
+  unsigned char *buf = __AFL_FUZZ_TESTCASE_BUF;
+
+  while (__AFL_LOOP(10000)) {
+    unsigned int len = __AFL_FUZZ_TESTCASE_LEN;
+    if (len > MAX_INPUT)
+      len = MAX_INPUT;
+    memcpy(input, buf, len);
+    run(argv[0], len);
+  }
+#elif BENCH_MODE == 1
+  while (__AFL_LOOP(10000))
+    run(argv[0], read_input(argc > 1 ? argv[1] : NULL));
+#else
+  run(argv[0], read_input(argc > 1 ? argv[1] : NULL));
+#endif
+  return 0;
+}
@@ -0,0 +1,4 @@
+#!/bin/bash
+# Benchmark every Vulnerable harness in every execution mode.
+# Usage: ./run.sh [seconds per run]
+./bench.py --seconds "${1:-60}"
@@ -0,0 +1,9 @@
+#!/bin/bash
+# Build the DataFlowSanitizer tracer of a harness, and the mutator.
+# Usage: ./build.sh <harness .c> <tracer name>
+clang -O0 -g -fsanitize=dataflow -fsanitize-dataflow-abilist=bytetaint_abilist.txt \
+  -fsanitize-coverage=trace-cmp -include ../Minimize/harness.h -c "$1" -o "$2.o"
+# The tracer itself must not be instrumented, DFSan calls its callbacks
+clang -O2 -g -c bytetaint_tracer.c -o bytetaint_tracer.o
+clang -fsanitize=dataflow "$2.o" bytetaint_tracer.o -o "$2" -ldl
+clang -O2 -shared -fPIC bytetaint_mutator.c -o bytetaint_mutator.so
@@ -0,0 +1,40 @@
+// Offset-to-branch map of one queue entry, written by bytetaint_tracer and
+// read by bytetaint_mutator.so. All fields are little endian uint32_t:
+//   MapHeader
+//   MapBranch branches[num_branches]  sorted by site
+//   MapRange  ranges[num_ranges]      grouped by branch, sorted by start
+// A site is a compare of the target, identified by its offset in the tracer
+// binary. Only the first traced_len bytes of the input were traced.
+
+#ifndef BYTETAINT_H
+#define BYTETAINT_H
+
+#include <stdint.h>
+
+#define BYTETAINT_MAGIC 0x314d5442U // "BTM1"
+
+// The compare depends on the length of the input (every byte up to the
+// terminating NUL, e.g. through strlen), not on byte values; no ranges.
+#define BRANCH_LENGTH 1
+
+typedef struct {
+  uint32_t magic;
+  uint32_t input_len;
+  uint32_t traced_len;
+  uint32_t num_branches;
+  uint32_t num_ranges;
+} MapHeader;
+
+typedef struct {
+  uint32_t site;
+  uint32_t flags;
+  uint32_t first_range;
+  uint32_t num_ranges;
+} MapBranch;
+
+typedef struct {
+  uint32_t start;
+  uint32_t len;
+} MapRange;
+
+#endif
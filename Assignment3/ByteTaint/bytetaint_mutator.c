@@ -0,0 +1,254 @@
+// AFL++ custom mutator that only mutates the input bytes the target's
+// compares depend on.
+//
+// Before a queue entry is fuzzed, its offset-to-branch map is loaded from
+// <queue>/.bytetaint/<entry>, running BYTETAINT_TRACER (bytetaint_tracer) on
+// the entry first if the map does not exist yet. Every mutation then picks
+// one branch of the map and changes one of the offsets it depends on, or the
+// length of the input for a length compare, e.g. the strlen() based checks of
+// process_raw_string. Bytes past the traced prefix were never traced and stay
+// fair game. Without a map the mutator falls back to random bytes anywhere.
+//
+// Usage: BYTETAINT_TRACER=./<tracer> AFL_CUSTOM_MUTATOR_LIBRARY=./bytetaint_mutator.so
+//        AFL_CUSTOM_MUTATOR_ONLY=1 afl-fuzz ...
+
+#define _GNU_SOURCE
+#include <libgen.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bytetaint.h"
+
+#define MAX_STACK 4
+#define MAX_GROW 4
+
+static const uint8_t interesting[] = {0x00, 0x01, 0x7f, 0x80, 0xff, 'A', 'a',
+                                      'z',  '0',  '9',  ' ',  '\n', '%'};
+
+enum { OP_RANDOM, OP_ARITH, OP_INTERESTING, OP_COPY, OP_LENGTH, OP_UNTRACED,
+       OP_ANY, OP_COUNT };
+
+static const char *op_names[OP_COUNT] = {"taint-random", "taint-arith",
+                                         "taint-interesting", "taint-copy",
+                                         "taint-length", "taint-untraced",
+                                         "taint-any"};
+
+typedef struct {
+  uint64_t rng;
+  uint8_t *buf;
+  size_t size;
+  const char *tracer;
+  int last_op;
+
+  // Map of the queue entry being fuzzed
+  MapHeader header;
+  MapBranch *branches;
+  MapRange *ranges;
+} ByteTaintMutator;
+
+static uint64_t next_rand(ByteTaintMutator *m) {
+  // xorshift64*
+  m->rng ^= m->rng >> 12;
+  m->rng ^= m->rng << 25;
+  m->rng ^= m->rng >> 27;
+  return m->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static uint32_t rand_below(ByteTaintMutator *m, uint32_t limit) {
+  return limit ? next_rand(m) % limit : 0;
+}
+
+static int reserve(ByteTaintMutator *m, size_t size) {
+  if (size <= m->size)
+    return 1;
+  uint8_t *buf = realloc(m->buf, size);
+  if (!buf)
+    return 0;
+  m->buf = buf;
+  m->size = size;
+  return 1;
+}
+
+static void free_map(ByteTaintMutator *m) {
+  free(m->branches);
+  free(m->ranges);
+  m->branches = NULL;
+  m->ranges = NULL;
+  memset(&m->header, 0, sizeof(m->header));
+}
+
+static void run_tracer(ByteTaintMutator *m, const char *entry, const char *map) {
+  pid_t pid = fork();
+  if (pid < 0)
+    return;
+  if (pid == 0) {
+    execl(m->tracer, m->tracer, entry, map, (char *)NULL);
+    _exit(1);
+  }
+  waitpid(pid, NULL, 0);
+}
+
+static int read_map(ByteTaintMutator *m, const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return 0;
+  MapHeader header;
+  int ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == BYTETAINT_MAGIC;
+  if (ok) {
+    m->branches = calloc(header.num_branches + 1, sizeof(MapBranch));
+    m->ranges = calloc(header.num_ranges + 1, sizeof(MapRange));
+    ok = m->branches && m->ranges &&
+         fread(m->branches, sizeof(MapBranch), header.num_branches, f) == header.num_branches &&
+         fread(m->ranges, sizeof(MapRange), header.num_ranges, f) == header.num_ranges;
+  }
+  fclose(f);
+  if (!ok) {
+    free_map(m);
+    return 0;
+  }
+  m->header = header;
+  return 1;
+}
+
+// A byte of the input, or of the NUL after it when a compare depends on it
+static size_t pick_offset(ByteTaintMutator *m, MapBranch *branch) {
+  MapRange *range = &m->ranges[branch->first_range + rand_below(m, branch->num_ranges)];
+  return range->start + rand_below(m, range->len);
+}
+
+static size_t set_length(ByteTaintMutator *m, size_t len, size_t new_len) {
+  for (size_t i = len; i < new_len; i++)
+    m->buf[i] = 1 + rand_below(m, 255);
+  return new_len;
+}
+
+static size_t mutate_once(ByteTaintMutator *m, size_t len, size_t max_size) {
+  int op = OP_ANY;
+  size_t offset = len ? rand_below(m, len) : 0;
+
+  if (m->header.num_branches) {
+    MapBranch *branch = &m->branches[rand_below(m, m->header.num_branches)];
+    if (len > m->header.traced_len && !rand_below(m, 8)) {
+      op = OP_UNTRACED;
+      offset = m->header.traced_len + rand_below(m, len - m->header.traced_len);
+    } else if (branch->flags & BRANCH_LENGTH) {
+      op = OP_LENGTH;
+    } else if (branch->num_ranges) {
+      op = rand_below(m, OP_COPY + 1);
+      offset = pick_offset(m, branch);
+    }
+  }
+
+  // The offset after the last byte is the terminator, write past it
+  if (op != OP_LENGTH && offset >= len) {
+    len = set_length(m, len, offset + 1);
+  }
+
+  switch (op) {
+  case OP_RANDOM:
+  case OP_UNTRACED:
+  case OP_ANY:
+    m->buf[offset] = next_rand(m);
+    break;
+
+  case OP_ARITH: {
+    int delta = 1 + rand_below(m, 16);
+    m->buf[offset] += rand_below(m, 2) ? delta : -delta;
+    break;
+  }
+
+  case OP_INTERESTING:
+    m->buf[offset] = interesting[rand_below(m, sizeof(interesting))];
+    break;
+
+  case OP_COPY: {
+    // Another byte of a compare, e.g. both sides of a check on two offsets
+    MapBranch *other = &m->branches[rand_below(m, m->header.num_branches)];
+    size_t from = other->num_ranges ? pick_offset(m, other) : offset;
+    if (from < len)
+      m->buf[offset] = m->buf[from];
+    break;
+  }
+
+  case OP_LENGTH: {
+    int delta = 1 + rand_below(m, MAX_GROW);
+    len = set_length(m, len, rand_below(m, 2) || (size_t)delta > len ? len + delta
+                                                                      : len - delta);
+    break;
+  }
+  }
+
+  m->last_op = op;
+  return len > max_size ? max_size : len;
+}
+
+void *afl_custom_init(void *afl, unsigned int seed) {
+  (void)afl;
+  ByteTaintMutator *m = calloc(1, sizeof(ByteTaintMutator));
+  if (!m)
+    return NULL;
+  m->rng = seed ? seed : 0x9E3779B97F4A7C15ULL;
+  m->tracer = getenv("BYTETAINT_TRACER");
+  return m;
+}
+
+// Called before AFL fuzzes a queue entry; load (or trace) its map.
+uint8_t afl_custom_queue_get(void *data, const uint8_t *filename) {
+  ByteTaintMutator *m = data;
+  free_map(m);
+
+  char dir[4096], name[4096], map[8192];
+  snprintf(dir, sizeof(dir), "%s", (const char *)filename);
+  snprintf(name, sizeof(name), "%s", (const char *)filename);
+  snprintf(map, sizeof(map), "%s/.bytetaint", dirname(dir));
+  mkdir(map, 0755);
+  snprintf(map + strlen(map), sizeof(map) - strlen(map), "/%s", basename(name));
+
+  if (!read_map(m, map) && m->tracer) {
+    run_tracer(m, (const char *)filename, map);
+    read_map(m, map);
+  }
+  return 1;
+}
+
+size_t afl_custom_fuzz(void *data, uint8_t *buf, size_t buf_size,
+                       uint8_t **out_buf, uint8_t *add_buf, size_t add_buf_size,
+                       size_t max_size) {
+  ByteTaintMutator *m = data;
+  (void)add_buf;
+  (void)add_buf_size;
+
+  // The map may point at the NUL after the input, and lengths grow
+  size_t limit = buf_size > m->header.traced_len ? buf_size : m->header.traced_len;
+  if (!reserve(m, limit + 1 + MAX_GROW * MAX_STACK)) {
+    *out_buf = buf;
+    return buf_size;
+  }
+  memcpy(m->buf, buf, buf_size);
+
+  size_t len = buf_size;
+  int stack = 1 + rand_below(m, MAX_STACK);
+  for (int i = 0; i < stack; i++)
+    len = mutate_once(m, len, max_size);
+
+  *out_buf = m->buf;
+  return len;
+}
+
+const char *afl_custom_describe(void *data, size_t max_description_len) {
+  ByteTaintMutator *m = data;
+  (void)max_description_len;
+  return op_names[m->last_op];
+}
+
+void afl_custom_deinit(void *data) {
+  ByteTaintMutator *m = data;
+  free_map(m);
+  free(m->buf);
+  free(m);
+}
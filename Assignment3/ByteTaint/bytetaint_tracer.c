@@ -0,0 +1,286 @@
+// DataFlowSanitizer tracer: which input offsets does each compare depend on?
+//
+// The fuzz target is compiled with -fsanitize=dataflow
+// -fsanitize-coverage=trace-cmp and -include ../Minimize/harness.h, and
+// linked with this file, which is not instrumented itself. DFSan calls the
+// __dfsw_ versions of the trace-cmp callbacks below with the labels of both
+// operands, so every compare reports the input bytes it depends on.
+//
+// DFSan has 8 labels, one bit each, so the input is traced 8 bytes at a
+// time: byte 8 * chunk + i gets label 1 << i, and the target runs once per
+// chunk in a forked child (a crash or hang only loses that chunk). The byte
+// after the input, the NUL that argv and the shared-memory harnesses see,
+// is traced too. DFSAN_OPTIONS=strict_data_dependencies=0 makes strlen()
+// return the labels of the bytes it read, so a compare that depends on
+// every offset up to that NUL is stored as a length compare.
+//
+// Usage: bytetaint_tracer <input file> [map file]
+// Without a map file the branches are listed on stdout.
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sanitizer/dfsan_interface.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bytetaint.h"
+
+#define MAX_INPUT (1024 * 1024)
+#define MAX_TRACED 4096
+#define CHUNK 8
+#define TABLE_SIZE (1 << 16)
+#define TIMEOUT_SECONDS 2
+
+#define FATAL(...)                                                             \
+  do {                                                                         \
+    fprintf(stderr, "[-] " __VA_ARGS__);                                       \
+    fputc('\n', stderr);                                                       \
+    exit(1);                                                                   \
+  } while (0)
+
+// Labels seen at one site in one chunk
+typedef struct {
+  uint32_t site;
+  uint32_t chunk;
+  uint8_t labels;
+  uint8_t used;
+} Hit;
+
+// DFSan renames every instrumented function it has no ABI list entry for,
+// so the target's (renamed) main is only reachable under its .dfsan name.
+// Its return value is not used, see harness.h.
+int harness_main() __asm__("harness_main.dfsan");
+
+// Runtime behind the macros in harness.h. bytetaint_abilist.txt keeps the
+// target's calls of minimize_loop() uninstrumented.
+unsigned char *minimize_testcase_buf;
+unsigned int minimize_testcase_len;
+static unsigned int loop_left;
+
+int minimize_loop(unsigned int max_cnt) {
+  (void)max_cnt;
+  if (!loop_left)
+    return 0;
+  loop_left--;
+  return 1;
+}
+
+static unsigned char input[MAX_INPUT + 1];
+static Hit *hits; // shared with the children
+static uint32_t current_chunk;
+static uintptr_t base;
+
+static void record(dfsan_label labels, void *pc) {
+  if (!labels)
+    return;
+  uint32_t site = (uint32_t)((uintptr_t)pc - base);
+  uint32_t h = (site * 0x9E3779B1U + current_chunk) & (TABLE_SIZE - 1);
+  for (uint32_t i = 0; i < TABLE_SIZE; i++) {
+    Hit *hit = &hits[(h + i) & (TABLE_SIZE - 1)];
+    if (!hit->used) {
+      hit->used = 1;
+      hit->site = site;
+      hit->chunk = current_chunk;
+    }
+    if (hit->site == site && hit->chunk == current_chunk) {
+      hit->labels |= labels;
+      return;
+    }
+  }
+}
+
+#define CMP_CALLBACK(name, type)                                               \
+  void __dfsw___sanitizer_cov_trace_##name(type a, type b, dfsan_label la,      \
+                                           dfsan_label lb) {                   \
+    (void)a;                                                                   \
+    (void)b;                                                                   \
+    record(la | lb, __builtin_return_address(0));                              \
+  }
+
+CMP_CALLBACK(cmp1, uint8_t)
+CMP_CALLBACK(cmp2, uint16_t)
+CMP_CALLBACK(cmp4, uint32_t)
+CMP_CALLBACK(cmp8, uint64_t)
+CMP_CALLBACK(const_cmp1, uint8_t)
+CMP_CALLBACK(const_cmp2, uint16_t)
+CMP_CALLBACK(const_cmp4, uint32_t)
+CMP_CALLBACK(const_cmp8, uint64_t)
+
+void __dfsw___sanitizer_cov_trace_switch(uint64_t value, uint64_t *cases,
+                                         dfsan_label lvalue, dfsan_label lcases) {
+  (void)value;
+  (void)cases;
+  (void)lcases;
+  record(lvalue, __builtin_return_address(0));
+}
+
+// Run the target once on the input with the labels of one chunk
+static void run_chunk(char *prog, uint32_t len, uint32_t traced, uint32_t chunk) {
+  pid_t pid = fork();
+  if (pid < 0)
+    FATAL("fork failed");
+  if (pid == 0) {
+    char *argv[] = {prog, (char *)input, NULL};
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, 1);
+    dup2(devnull, 2);
+    alarm(TIMEOUT_SECONDS);
+
+    current_chunk = chunk;
+    dfsan_set_label(0, input, len + 1);
+    for (uint32_t i = 0; i < CHUNK && chunk * CHUNK + i < traced; i++)
+      dfsan_set_label(1 << i, input + chunk * CHUNK + i, 1);
+
+    minimize_testcase_buf = input;
+    minimize_testcase_len = len;
+    loop_left = 1;
+    harness_main(2, argv);
+    _exit(0);
+  }
+  waitpid(pid, NULL, 0);
+}
+
+static int compare_hits(const void *a, const void *b) {
+  const Hit *x = a, *y = b;
+  if (x->site != y->site)
+    return x->site < y->site ? -1 : 1;
+  return x->chunk < y->chunk ? -1 : x->chunk > y->chunk;
+}
+
+// Collect the hits into the map. One offset flag per traced byte is enough
+// for one site at a time.
+static void write_map(FILE *out, int text, uint32_t len, uint32_t traced) {
+  Hit *sorted = malloc(TABLE_SIZE * sizeof(Hit));
+  uint8_t *offsets = malloc(traced);
+  MapBranch *branches = malloc(TABLE_SIZE * sizeof(MapBranch));
+  MapRange *ranges = malloc(TABLE_SIZE * sizeof(MapRange));
+  if (!sorted || !offsets || !branches || !ranges)
+    FATAL("out of memory");
+
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < TABLE_SIZE; i++) {
+    if (hits[i].used)
+      sorted[n++] = hits[i];
+  }
+  qsort(sorted, n, sizeof(Hit), compare_hits);
+
+  MapHeader header = {BYTETAINT_MAGIC, len, traced, 0, 0};
+  for (uint32_t i = 0; i < n;) {
+    uint32_t site = sorted[i].site;
+    memset(offsets, 0, traced);
+    for (; i < n && sorted[i].site == site; i++) {
+      for (uint32_t bit = 0; bit < CHUNK; bit++) {
+        uint32_t offset = sorted[i].chunk * CHUNK + bit;
+        if ((sorted[i].labels & (1 << bit)) && offset < traced)
+          offsets[offset] = 1;
+      }
+    }
+
+    MapBranch *branch = &branches[header.num_branches++];
+    branch->site = site;
+    branch->flags = 0;
+    branch->first_range = header.num_ranges;
+    branch->num_ranges = 0;
+
+    // All of the input and its NUL: a length compare
+    if (traced == len + 1 && memchr(offsets, 0, traced) == NULL) {
+      branch->flags = BRANCH_LENGTH;
+      continue;
+    }
+    for (uint32_t start = 0; start < traced; start++) {
+      if (!offsets[start])
+        continue;
+      uint32_t end = start;
+      while (end < traced && offsets[end])
+        end++;
+      if (header.num_ranges < TABLE_SIZE) {
+        ranges[header.num_ranges++] = (MapRange){start, end - start};
+        branch->num_ranges++;
+      }
+      start = end;
+    }
+  }
+
+  if (text) {
+    fprintf(out, "input %u bytes, %u traced, %u branches\n", len, traced,
+            header.num_branches);
+    for (uint32_t i = 0; i < header.num_branches; i++) {
+      fprintf(out, "0x%x", branches[i].site);
+      if (branches[i].flags & BRANCH_LENGTH)
+        fprintf(out, " length");
+      for (uint32_t r = 0; r < branches[i].num_ranges; r++) {
+        MapRange *range = &ranges[branches[i].first_range + r];
+        if (range->len == 1)
+          fprintf(out, " %u", range->start);
+        else
+          fprintf(out, " %u-%u", range->start, range->start + range->len - 1);
+      }
+      fputc('\n', out);
+    }
+  } else {
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(branches, sizeof(MapBranch), header.num_branches, out);
+    fwrite(ranges, sizeof(MapRange), header.num_ranges, out);
+  }
+
+  free(sorted);
+  free(offsets);
+  free(branches);
+  free(ranges);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2)
+    FATAL("usage: %s <input file> [map file]", argv[0]);
+
+  // strlen() and friends only pass the labels on with this option, which
+  // is read when the runtime starts
+  const char *options = getenv("DFSAN_OPTIONS");
+  if (!options || !strstr(options, "strict_data_dependencies=0")) {
+    setenv("DFSAN_OPTIONS", "strict_data_dependencies=0", 1);
+    execv("/proc/self/exe", argv);
+    FATAL("cannot restart with DFSAN_OPTIONS");
+  }
+
+  FILE *f = fopen(argv[1], "rb");
+  if (!f)
+    FATAL("cannot read %s", argv[1]);
+  uint32_t len = fread(input, 1, MAX_INPUT, f);
+  fclose(f);
+
+  Dl_info info;
+  if (dladdr((void *)main, &info))
+    base = (uintptr_t)info.dli_fbase;
+
+  hits = mmap(NULL, TABLE_SIZE * sizeof(Hit), PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (hits == MAP_FAILED)
+    FATAL("mmap failed");
+
+  uint32_t traced = len + 1 < MAX_TRACED ? len + 1 : MAX_TRACED;
+  for (uint32_t chunk = 0; chunk * CHUNK < traced; chunk++)
+    run_chunk(argv[0], len, traced, chunk);
+
+  if (argc < 3) {
+    write_map(stdout, 1, len, traced);
+    return 0;
+  }
+
+  // Written next to the final name, so the mutator never reads half a map
+  char tmp[4096];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", argv[2]);
+  FILE *out = fopen(tmp, "wb");
+  if (!out)
+    FATAL("cannot write %s", tmp);
+  write_map(out, 0, len, traced);
+  fclose(out);
+  if (rename(tmp, argv[2]))
+    FATAL("cannot write %s", argv[2]);
+  return 0;
+}
@@ -0,0 +1,8 @@
+#!/bin/bash
+# Fuzz a harness with mutations restricted to the offsets its compares
+# depend on. Trimming is off so the maps keep matching the queue entries.
+# Usage: ./run.sh <harness dir, e.g. ../Vulnerable/shared_memory> <tracer> [target, default AFL2]
+cd "$1"
+BYTETAINT_TRACER="$OLDPWD/$2" AFL_CUSTOM_MUTATOR_LIBRARY="$OLDPWD/bytetaint_mutator.so" \
+  AFL_CUSTOM_MUTATOR_ONLY=1 AFL_DISABLE_TRIM=1 \
+  afl-fuzz -i input -o output_bytetaint -m none -- "./${3:-AFL2}"
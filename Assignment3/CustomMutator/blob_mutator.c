@@ -0,0 +1,183 @@
+// AFL++ custom mutator for the Blob-parsing target (process_raw_string).
+//
+// process_raw_string only looks at strlen() of its input: it becomes the
+// blob length, size1 = 2 * length, and the branches split on size1 / 4,
+// size1 / 10 and size3 / 6. Bytes after the first NUL are never read, so
+// generic havoc wastes most executions. This mutator treats a test case as
+//   header   the first 4 bytes (Blob.header)
+//   payload  the remaining bytes up to the end
+//   length   the number of bytes before the terminating NUL
+// and never emits a NUL, so every byte produced is part of the blob. Lengths
+// are drawn around the branch boundaries, header and payload are mutated
+// separately, and all work happens in place in one buffer reused across calls.
+//
+// Usage: AFL_CUSTOM_MUTATOR_LIBRARY=./blob_mutator.so afl-fuzz ...
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HEADER_LEN 4
+#define MAX_STACK 4
+
+// Lengths at which a branch of process_raw_string flips, and their
+// neighbours:  size1 / 4 == 0  <=> length < 2
+//              size1 / 10 == 0 <=> length < 5
+//              length == 0 divides by zero in size3 = length / blobSize
+static const uint32_t boundaries[] = {0,  1,  2,  3,  4,  5,   6,   9,   10,
+                                      11, 15, 16, 17, 31, 32,  33,  63,  64,
+                                      65, 99, 100, 101, 127, 128, 255, 256};
+
+static const uint8_t interesting[] = {'A', 'z', '0', '9', ' ', 0x01, 0x7f,
+                                      0x80, 0xff, '%', '\n'};
+
+enum { OP_LENGTH, OP_LENGTH_DELTA, OP_HEADER, OP_PAYLOAD, OP_PAYLOAD_BLOCK, OP_COUNT };
+
+static const char *op_names[OP_COUNT] = {"blob-length", "blob-length-delta",
+                                         "blob-header", "blob-payload",
+                                         "blob-payload-block"};
+
+typedef struct {
+  uint64_t rng;
+  uint8_t *buf;
+  size_t size;
+  int last_op;
+} BlobMutator;
+
+static uint64_t next_rand(BlobMutator *m) {
+  // xorshift64*
+  m->rng ^= m->rng >> 12;
+  m->rng ^= m->rng << 25;
+  m->rng ^= m->rng >> 27;
+  return m->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static uint32_t rand_below(BlobMutator *m, uint32_t limit) {
+  return limit ? next_rand(m) % limit : 0;
+}
+
+// Any byte but NUL, which would end the blob early.
+static uint8_t rand_byte(BlobMutator *m) {
+  if (rand_below(m, 2))
+    return interesting[rand_below(m, sizeof(interesting))];
+  return 1 + rand_below(m, 255);
+}
+
+static int reserve(BlobMutator *m, size_t size) {
+  if (size <= m->size)
+    return 1;
+  uint8_t *buf = realloc(m->buf, size);
+  if (!buf)
+    return 0;
+  m->buf = buf;
+  m->size = size;
+  return 1;
+}
+
+// Grow or shrink the blob to new_len, filling new payload with non-NUL bytes.
+static size_t set_length(BlobMutator *m, size_t len, size_t new_len) {
+  for (size_t i = len; i < new_len; i++)
+    m->buf[i] = rand_byte(m);
+  return new_len;
+}
+
+static size_t mutate_once(BlobMutator *m, size_t len, size_t max_size) {
+  int op = rand_below(m, OP_COUNT);
+
+  switch (op) {
+  case OP_LENGTH:
+    len = set_length(m, len,
+                     boundaries[rand_below(m, sizeof(boundaries) / sizeof(boundaries[0]))]);
+    break;
+
+  case OP_LENGTH_DELTA: {
+    int delta = (int)rand_below(m, 9) - 4;
+    len = set_length(m, len, (int)len + delta < 0 ? 0 : len + delta);
+    break;
+  }
+
+  case OP_HEADER: {
+    size_t header = len < HEADER_LEN ? len : HEADER_LEN;
+    if (!header) {
+      len = set_length(m, len, HEADER_LEN);
+      break;
+    }
+    m->buf[rand_below(m, header)] = rand_byte(m);
+    break;
+  }
+
+  case OP_PAYLOAD:
+    if (len <= HEADER_LEN) {
+      len = set_length(m, len, len + 1);
+      break;
+    }
+    m->buf[HEADER_LEN + rand_below(m, len - HEADER_LEN)] = rand_byte(m);
+    break;
+
+  case OP_PAYLOAD_BLOCK: {
+    if (len <= HEADER_LEN)
+      break;
+    size_t payload = len - HEADER_LEN;
+    size_t from = HEADER_LEN + rand_below(m, payload);
+    size_t to = HEADER_LEN + rand_below(m, payload);
+    size_t n = 1 + rand_below(m, len - (from > to ? from : to));
+    memmove(m->buf + to, m->buf + from, n);
+    break;
+  }
+  }
+
+  m->last_op = op;
+  return len > max_size ? max_size : len;
+}
+
+void *afl_custom_init(void *afl, unsigned int seed) {
+  (void)afl;
+  BlobMutator *m = calloc(1, sizeof(BlobMutator));
+  if (!m)
+    return NULL;
+  m->rng = seed ? seed : 0x9E3779B97F4A7C15ULL;
+  return m;
+}
+
+size_t afl_custom_fuzz(void *data, uint8_t *buf, size_t buf_size,
+                       uint8_t **out_buf, uint8_t *add_buf, size_t add_buf_size,
+                       size_t max_size) {
+  BlobMutator *m = data;
+  (void)add_buf;
+  (void)add_buf_size;
+
+  // Largest length the mutations below can produce: a boundary length or
+  // the input, grown by at most 4 bytes per stacked mutation
+  size_t limit = boundaries[sizeof(boundaries) / sizeof(boundaries[0]) - 1];
+  if (limit < buf_size)
+    limit = buf_size;
+  if (!reserve(m, limit + 4 * MAX_STACK)) {
+    *out_buf = buf;
+    return buf_size;
+  }
+
+  // The blob ends at the first NUL, like strlen() in the target
+  size_t len = 0;
+  while (len < buf_size && buf[len])
+    len++;
+  memcpy(m->buf, buf, len);
+
+  int stack = 1 + rand_below(m, MAX_STACK);
+  for (int i = 0; i < stack; i++)
+    len = mutate_once(m, len, max_size);
+
+  *out_buf = m->buf;
+  return len;
+}
+
+const char *afl_custom_describe(void *data, size_t max_description_len) {
+  BlobMutator *m = data;
+  (void)max_description_len;
+  return op_names[m->last_op];
+}
+
+void afl_custom_deinit(void *data) {
+  BlobMutator *m = data;
+  free(m->buf);
+  free(m);
+}
@@ -0,0 +1,2 @@
+#!/bin/bash
+clang -O2 -shared -fPIC blob_mutator.c -o blob_mutator.so
@@ -0,0 +1,5 @@
+#!/bin/bash
+# Fuzz a Blob harness with the structure-aware mutator next to havoc.
+# Usage: ./run.sh <harness dir, e.g. ../Vulnerable/shared_memory>
+cd "$1"
+AFL_CUSTOM_MUTATOR_LIBRARY="$OLDPWD/blob_mutator.so" afl-fuzz -i input -o output_blob -m none -D -- ./AFL2
@@ -0,0 +1,5 @@
+#!/bin/bash
+# Link a persistent or argv harness into the minimizer.
+# Usage: ./build.sh <harness .c> <minimizer name>
+clang -O2 -g -fsanitize-coverage=trace-pc-guard -include harness.h -c "$1" -o "$2.o"
+clang -O2 -g minimize.c "$2.o" -o "$2"
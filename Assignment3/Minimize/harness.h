@@ -0,0 +1,33 @@
+// Force-included (-include harness.h) when a fuzz target is linked into the
+// minimizer or a benchmark driver. It maps the afl-clang-fast persistent/
+// shared-memory macros onto the in-process runtime of the driver, and renames
+// the target's main so the driver can call it once per execution.
+
+#ifndef MINIMIZE_HARNESS_H
+#define MINIMIZE_HARNESS_H
+
+extern unsigned char *minimize_testcase_buf;
+extern unsigned int minimize_testcase_len;
+int minimize_loop(unsigned int max_cnt);
+
+// afl-clang-fast predefines these on the command line.
+#undef __AFL_HAVE_MANUAL_CONTROL
+#undef __AFL_INIT
+#undef __AFL_FUZZ_INIT
+#undef __AFL_FUZZ_TESTCASE_BUF
+#undef __AFL_FUZZ_TESTCASE_LEN
+#undef __AFL_LOOP
+
+#define __AFL_HAVE_MANUAL_CONTROL 1
+#define __AFL_INIT() do { } while (0)
+#define __AFL_FUZZ_INIT() extern unsigned char *minimize_testcase_buf
+#define __AFL_FUZZ_TESTCASE_BUF minimize_testcase_buf
+#define __AFL_FUZZ_TESTCASE_LEN minimize_testcase_len
+#define __AFL_LOOP(x) minimize_loop(x)
+
+// The drivers call harness_main(2, argv), which fits both `int main()` and
+// `int main(int argc, char **argv)`. Only main itself returns 0 when it runs
+// off its end, so the value harness_main returns is never used.
+#define main harness_main
+
+#endif
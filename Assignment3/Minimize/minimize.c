@@ -0,0 +1,507 @@
+// In-process corpus (afl-cmin) and testcase (afl-tmin) minimizer.
+//
+// The fuzz target is compiled with -fsanitize-coverage=trace-pc-guard and
+// -include harness.h, and linked into this binary. Every execution is a plain
+// call to the target's main from one of the worker processes, so no process
+// is created per execution. A worker only has to be replaced when the target
+// crashes or hangs under it.
+//
+// Usage: minimize -i <queue dir> -o <out dir> [-j workers] [-t ms] [-C]
+//   -C  only reduce the corpus, do not minimize the kept testcases
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MAP_SIZE (1 << 16)
+#define MAX_FILE (1024 * 1024)
+#define TRIM_START_STEPS 16
+
+#define FATAL(...)                                                             \
+  do {                                                                         \
+    fprintf(stderr, "[-] " __VA_ARGS__);                                       \
+    fputc('\n', stderr);                                                       \
+    exit(1);                                                                   \
+  } while (0)
+
+enum { ST_PENDING, ST_OK, ST_CRASH, ST_HANG };
+
+typedef struct {
+  char *name;
+  uint8_t *data;
+  uint32_t len;
+} Input;
+
+// Resumable afl-tmin state of one kept testcase. It lives in shared memory so
+// that a replacement worker can continue after a candidate killed the last one.
+typedef struct {
+  uint32_t stage;
+  uint32_t del_len;
+  uint32_t pos;
+  uint32_t changed;
+  uint32_t reject;
+  uint32_t len;
+  uint8_t *buf;
+} TminJob;
+
+typedef struct {
+  uint32_t next;
+  int32_t cur[];
+} Pool;
+
+// The target's main, either `int main()` or `int main(int, char **)`. Its
+// return value is undefined unless the target returns explicitly, see harness.h.
+int harness_main();
+
+// Runtime behind the macros in harness.h.
+unsigned char *minimize_testcase_buf;
+unsigned int minimize_testcase_len;
+static unsigned int loop_left;
+
+int minimize_loop(unsigned int max_cnt) {
+  (void)max_cnt;
+  if (!loop_left)
+    return 0;
+  loop_left--;
+  return 1;
+}
+
+// Coverage map written by the SanitizerCoverage callbacks.
+static uint8_t cov_map[MAP_SIZE];
+static uint32_t guard_count;
+static uint32_t map_size;
+
+void __sanitizer_cov_trace_pc_guard_init(uint32_t *start, uint32_t *stop) {
+  if (start == stop || *start)
+    return;
+  for (uint32_t *g = start; g < stop; g++)
+    *g = ++guard_count % MAP_SIZE;
+}
+
+void __sanitizer_cov_trace_pc_guard(uint32_t *guard) { cov_map[*guard]++; }
+
+// AFL hit count buckets, one bit per bucket.
+static const uint8_t count_class[256] = {
+    [0] = 0,           [1] = 1,           [2] = 2,
+    [3] = 4,           [4 ... 7] = 8,     [8 ... 15] = 16,
+    [16 ... 31] = 32,  [32 ... 127] = 64, [128 ... 255] = 128};
+
+static Input *inputs;
+static uint32_t n_inputs;
+static uint32_t n_workers;
+static uint32_t exec_tmout = 1000;
+static char *prog_name;
+
+static Pool *pool;
+static uint8_t *status;
+static uint8_t *traces;
+static uint32_t *kept;
+static uint32_t n_kept;
+static TminJob *jobs;
+
+static void *shared_alloc(size_t size) {
+  void *p = mmap(NULL, size ? size : 1, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    FATAL("mmap of %zu bytes failed", size);
+  return p;
+}
+
+static void set_timer(uint32_t ms) {
+  struct itimerval it = {{0, 0}, {ms / 1000, (ms % 1000) * 1000}};
+  setitimer(ITIMER_REAL, &it, NULL);
+}
+
+// Execute one testcase in-process and leave its classified trace in cov_map.
+static void run_one(const uint8_t *data, uint32_t len) {
+  char *argv[] = {prog_name, (char *)minimize_testcase_buf, NULL};
+
+  memcpy(minimize_testcase_buf, data, len);
+  minimize_testcase_buf[len] = '\0';
+  minimize_testcase_len = len;
+  memset(cov_map, 0, map_size);
+  loop_left = 1;
+
+  set_timer(exec_tmout);
+  harness_main(2, argv);
+  set_timer(0);
+
+  for (uint32_t i = 0; i < map_size; i++)
+    cov_map[i] = count_class[cov_map[i]];
+}
+
+static void cmin_worker(uint32_t w) {
+  for (;;) {
+    uint32_t i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+    if (i >= n_inputs)
+      return;
+    pool->cur[w] = i;
+    run_one(inputs[i].data, inputs[i].len);
+    memcpy(traces + (size_t)i * map_size, cov_map, map_size);
+    status[i] = ST_OK;
+    pool->cur[w] = -1;
+  }
+}
+
+// Build the next afl-tmin candidate of a job. Block deletion with shrinking
+// block sizes first, then byte normalization to '0'; both are repeated until
+// a full round changes nothing. Returns 0 when the job is finished.
+static int next_candidate(TminJob *job, uint8_t *cand, uint32_t *cand_len) {
+  for (;;) {
+    if (job->stage == 0) {
+      if (job->pos >= job->len) {
+        job->del_len /= 2;
+        job->pos = 0;
+        if (!job->del_len)
+          job->stage = 1;
+        continue;
+      }
+      uint32_t del = job->del_len;
+      if (del > job->len - job->pos)
+        del = job->len - job->pos;
+      if (del == job->len) {
+        job->pos += del;
+        continue;
+      }
+      memcpy(cand, job->buf, job->pos);
+      memcpy(cand + job->pos, job->buf + job->pos + del,
+             job->len - job->pos - del);
+      *cand_len = job->len - del;
+      return 1;
+    }
+
+    if (job->pos >= job->len) {
+      if (!job->changed)
+        return 0;
+      uint32_t p2 = 1;
+      while (p2 < job->len)
+        p2 <<= 1;
+      job->stage = 0;
+      job->del_len = p2 / TRIM_START_STEPS ? p2 / TRIM_START_STEPS : 1;
+      job->pos = 0;
+      job->changed = 0;
+      continue;
+    }
+    if (job->buf[job->pos] == '0') {
+      job->pos++;
+      continue;
+    }
+    memcpy(cand, job->buf, job->len);
+    cand[job->pos] = '0';
+    *cand_len = job->len;
+    return 1;
+  }
+}
+
+static void advance(TminJob *job, int keep, const uint8_t *cand,
+                    uint32_t cand_len) {
+  if (keep) {
+    memcpy(job->buf, cand, cand_len);
+    job->len = cand_len;
+    job->changed = 1;
+    if (job->stage == 1)
+      job->pos++;
+  } else {
+    job->pos += job->stage == 0 ? job->del_len : 1;
+  }
+}
+
+static void tmin_job(uint32_t j, uint8_t *cand) {
+  TminJob *job = &jobs[j];
+  const uint8_t *ref = traces + (size_t)kept[j] * map_size;
+  uint32_t cand_len;
+
+  while (next_candidate(job, cand, &cand_len)) {
+    int keep = 0;
+    if (job->reject) {
+      // The previous worker died on this candidate.
+      job->reject = 0;
+    } else {
+      run_one(cand, cand_len);
+      keep = !memcmp(cov_map, ref, map_size);
+    }
+    advance(job, keep, cand, cand_len);
+  }
+}
+
+static void tmin_worker(uint32_t w) {
+  uint8_t *cand = malloc(MAX_FILE + 1);
+
+  if (pool->cur[w] >= 0) {
+    tmin_job(pool->cur[w], cand);
+    pool->cur[w] = -1;
+  }
+
+  for (;;) {
+    uint32_t j = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+    if (j >= n_kept)
+      break;
+    pool->cur[w] = j;
+    tmin_job(j, cand);
+    pool->cur[w] = -1;
+  }
+  free(cand);
+}
+
+static pid_t spawn(uint32_t w, void (*body)(uint32_t)) {
+  pid_t pid = fork();
+  if (pid < 0)
+    FATAL("fork failed: %s", strerror(errno));
+  if (!pid) {
+    int fd = open("/dev/null", O_RDWR);
+    dup2(fd, 1);
+    dup2(fd, 2);
+    close(fd);
+    body(w);
+    _exit(0);
+  }
+  return pid;
+}
+
+// Run a worker body on every core, replacing workers that the target kills.
+// on_death is told which item the worker held and which signal killed it.
+static void run_pool(void (*body)(uint32_t),
+                     void (*on_death)(uint32_t w, int sig)) {
+  pid_t *pids = calloc(n_workers, sizeof(pid_t));
+  uint32_t live = 0;
+
+  pool->next = 0;
+  for (uint32_t w = 0; w < n_workers; w++) {
+    pool->cur[w] = -1;
+    pids[w] = spawn(w, body);
+    live++;
+  }
+
+  while (live) {
+    int st;
+    pid_t pid = waitpid(-1, &st, 0);
+    if (pid < 0) {
+      if (errno == EINTR)
+        continue;
+      FATAL("waitpid failed: %s", strerror(errno));
+    }
+
+    uint32_t w = 0;
+    while (w < n_workers && pids[w] != pid)
+      w++;
+    if (w == n_workers)
+      continue;
+
+    if (pool->cur[w] < 0) {
+      live--;
+      continue;
+    }
+    // Died while holding an item: a crash, a hang, or an exit() in the target.
+    on_death(w, WIFSIGNALED(st) ? WTERMSIG(st) : 0);
+    pids[w] = spawn(w, body);
+  }
+  free(pids);
+}
+
+static void cmin_death(uint32_t w, int sig) {
+  status[pool->cur[w]] = sig == SIGALRM ? ST_HANG : ST_CRASH;
+  pool->cur[w] = -1;
+}
+
+static void tmin_death(uint32_t w, int sig) {
+  (void)sig;
+  jobs[pool->cur[w]].reject = 1;
+}
+
+static int cmp_name(const void *a, const void *b) {
+  return strcmp(((const Input *)a)->name, ((const Input *)b)->name);
+}
+
+static void load_inputs(const char *dir) {
+  DIR *d = opendir(dir);
+  struct dirent *de;
+  uint32_t cap = 64;
+
+  if (!d)
+    FATAL("cannot open '%s': %s", dir, strerror(errno));
+  inputs = malloc(cap * sizeof(Input));
+
+  while ((de = readdir(d))) {
+    char path[4096];
+    struct stat sb;
+    if (de->d_name[0] == '.')
+      continue;
+    snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+    if (stat(path, &sb) || !S_ISREG(sb.st_mode) || !sb.st_size ||
+        sb.st_size > MAX_FILE)
+      continue;
+
+    FILE *f = fopen(path, "rb");
+    if (!f)
+      continue;
+    if (n_inputs == cap)
+      inputs = realloc(inputs, (cap *= 2) * sizeof(Input));
+    Input *in = &inputs[n_inputs];
+    in->name = strdup(de->d_name);
+    in->len = sb.st_size;
+    in->data = malloc(in->len);
+    if (fread(in->data, 1, in->len, f) == in->len)
+      n_inputs++;
+    fclose(f);
+  }
+  closedir(d);
+
+  if (!n_inputs)
+    FATAL("no usable inputs in '%s'", dir);
+  qsort(inputs, n_inputs, sizeof(Input), cmp_name);
+}
+
+// afl-cmin selection: every (edge, bucket) tuple is owned by the smallest
+// input that hits it; owners are then taken greedily until all tuples seen.
+static void select_corpus(void) {
+  uint32_t n_tuples = map_size * 8;
+  int32_t *best = malloc(n_tuples * sizeof(int32_t));
+  uint8_t *covered = calloc(n_tuples, 1);
+  uint8_t *taken = calloc(n_inputs, 1);
+
+  for (uint32_t t = 0; t < n_tuples; t++)
+    best[t] = -1;
+
+  for (uint32_t i = 0; i < n_inputs; i++) {
+    if (status[i] != ST_OK)
+      continue;
+    const uint8_t *tr = traces + (size_t)i * map_size;
+    for (uint32_t e = 0; e < map_size; e++) {
+      if (!tr[e])
+        continue;
+      uint32_t t = e * 8 + __builtin_ctz(tr[e]);
+      if (best[t] < 0 || inputs[i].len < inputs[best[t]].len)
+        best[t] = i;
+    }
+  }
+
+  kept = malloc(n_inputs * sizeof(uint32_t));
+  for (uint32_t t = 0; t < n_tuples; t++) {
+    if (covered[t] || best[t] < 0)
+      continue;
+    uint32_t i = best[t];
+    const uint8_t *tr = traces + (size_t)i * map_size;
+    for (uint32_t e = 0; e < map_size; e++)
+      if (tr[e])
+        covered[e * 8 + __builtin_ctz(tr[e])] = 1;
+    if (!taken[i]) {
+      taken[i] = 1;
+      kept[n_kept++] = i;
+    }
+  }
+
+  free(best);
+  free(covered);
+  free(taken);
+}
+
+static void write_output(const char *dir) {
+  if (mkdir(dir, 0700) && errno != EEXIST)
+    FATAL("cannot create '%s': %s", dir, strerror(errno));
+
+  for (uint32_t j = 0; j < n_kept; j++) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, inputs[kept[j]].name);
+    FILE *f = fopen(path, "wb");
+    if (!f)
+      FATAL("cannot write '%s': %s", path, strerror(errno));
+    fwrite(jobs[j].buf, 1, jobs[j].len, f);
+    fclose(f);
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *in_dir = NULL, *out_dir = NULL;
+  int cmin_only = 0, opt;
+
+  prog_name = argv[0];
+  n_workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+  while ((opt = getopt(argc, argv, "i:o:j:t:C")) > 0) {
+    switch (opt) {
+    case 'i': in_dir = optarg; break;
+    case 'o': out_dir = optarg; break;
+    case 'j': n_workers = atoi(optarg); break;
+    case 't': exec_tmout = atoi(optarg); break;
+    case 'C': cmin_only = 1; break;
+    default: in_dir = NULL; break;
+    }
+  }
+  if (!in_dir || !out_dir || !n_workers)
+    FATAL("usage: %s -i <queue dir> -o <out dir> [-j workers] [-t ms] [-C]",
+          argv[0]);
+
+  map_size = guard_count + 1 < MAP_SIZE ? guard_count + 1 : MAP_SIZE;
+  if (!guard_count)
+    FATAL("target is not built with -fsanitize-coverage=trace-pc-guard");
+
+  load_inputs(in_dir);
+  uint32_t max_len = 0;
+  for (uint32_t i = 0; i < n_inputs; i++)
+    if (inputs[i].len > max_len)
+      max_len = inputs[i].len;
+  minimize_testcase_buf = malloc(max_len + 1);
+
+  pool = shared_alloc(sizeof(Pool) + n_workers * sizeof(int32_t));
+  status = shared_alloc(n_inputs);
+  traces = shared_alloc((size_t)n_inputs * map_size);
+
+  run_pool(cmin_worker, cmin_death);
+
+  uint32_t crashes = 0, hangs = 0;
+  for (uint32_t i = 0; i < n_inputs; i++) {
+    if (status[i] == ST_CRASH || status[i] == ST_HANG) {
+      fprintf(stderr, "[!] %s: %s, dropped\n", inputs[i].name,
+              status[i] == ST_CRASH ? "crash" : "hang");
+      status[i] == ST_CRASH ? crashes++ : hangs++;
+    }
+  }
+
+  select_corpus();
+
+  // Each kept testcase gets its own slice of shared memory to shrink in.
+  size_t total = 0;
+  for (uint32_t j = 0; j < n_kept; j++)
+    total += inputs[kept[j]].len;
+  uint8_t *bufs = shared_alloc(total);
+  jobs = shared_alloc(n_kept * sizeof(TminJob));
+
+  uint64_t before = 0, after = 0;
+  for (uint32_t j = 0; j < n_kept; j++) {
+    Input *in = &inputs[kept[j]];
+    uint32_t p2 = 1;
+    while (p2 < in->len)
+      p2 <<= 1;
+    jobs[j].buf = bufs;
+    jobs[j].len = in->len;
+    jobs[j].del_len = p2 / TRIM_START_STEPS ? p2 / TRIM_START_STEPS : 1;
+    memcpy(bufs, in->data, in->len);
+    bufs += in->len;
+    before += in->len;
+  }
+
+  if (!cmin_only)
+    run_pool(tmin_worker, tmin_death);
+
+  for (uint32_t j = 0; j < n_kept; j++)
+    after += jobs[j].len;
+
+  write_output(out_dir);
+
+  printf("[+] %u inputs, %u crashes, %u hangs, %u kept (%u workers)\n",
+         n_inputs, crashes, hangs, n_kept, n_workers);
+  printf("[+] kept bytes: %llu -> %llu\n", (unsigned long long)before,
+         (unsigned long long)after);
+  return 0;
+}
@@ -0,0 +1,4 @@
+#!/bin/bash
+# Minimize a queue into a fresh seed directory on all cores.
+# Usage: ./run.sh <minimizer name> <queue dir> <seed dir>
+./$1 -i "$2" -o "$3"
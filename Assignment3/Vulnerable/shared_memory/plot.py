@@ -1,15 +1,49 @@
+import csv
+import os
+
 import matplotlib.pyplot as plt
 
-# Data
-time_intervals = [i*10 for i in range(0, 7)]  # [10, 20, 30, ...]
-crashes = [0, 4883, 9056, 13600, 18100, 22900, 27200]  # Converted 'k' to actual numbers
+# Data: tracked benchmark runs of this harness, see Assignment3/Benchmark/bench.py
+RESULTS = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                       '../../Benchmark/results')
+TARGET = 'shared_memory'
+
+
+# The tracked afl-fuzz run of this harness, used until bench.py has results
+ORIGINAL = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                        'output/default/plot_data')
+
+
+def read_plot_data(path):
+    with open(path) as f:
+        header = [h.strip() for h in f.readline().lstrip('#').split(',')]
+        rows = [[v.strip() for v in line.split(',')] for line in f if line.strip()]
+    crash_col = 'saved_crashes' if 'saved_crashes' in header else 'unique_crashes'
+    time_col, crash_col = header.index('relative_time'), header.index(crash_col)
+    return [int(r[time_col]) for r in rows], [int(r[crash_col]) for r in rows]
+
+
+# (label, time, crashes) of every benchmarked mode that has its plot_data
+series = []
+results_csv = os.path.join(RESULTS, 'results.csv')
+if os.path.exists(results_csv):
+    with open(results_csv) as f:
+        for row in csv.DictReader(f):
+            path = os.path.join(RESULTS, f"{TARGET}-{row['mode']}.plot_data")
+            if row['target'] == TARGET and os.path.exists(path):
+                series.append((f"{row['mode']} ({row['execs_per_sec']} execs/s)",)
+                              + read_plot_data(path))
+if not series:
+    series.append(('shmem (output/default)',) + read_plot_data(ORIGINAL))
 
 # Plotting
 plt.figure(figsize=(10,6))
-plt.plot(time_intervals, crashes, marker='o', linestyle='-', color='b')
+for label, time_intervals, crashes in series:
+    plt.plot(time_intervals, crashes, marker='o', linestyle='-', label=label)
 plt.title('Number of Crashes Detected by AFL Over Time')
 plt.xlabel('Elapsed Time (s)')
 plt.ylabel('Number of Crashes')
+plt.legend()
 plt.grid(True)
 
 # Display the plot
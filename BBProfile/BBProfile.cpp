@@ -0,0 +1,250 @@
+// Per-basic-block and per-call-site cycle profiling for fuzz targets.
+//
+// Every basic block and every call site gets an id and a pair of 64-bit
+// counters (entries, cycles) in the table of bbprofile_rt.c, which lives in
+// shared memory so that it survives forks and crashes of the target:
+//   - a block reads the cycle counter (rdtsc on x86) on entry and adds the
+//     elapsed cycles, including the calls it makes, before its terminator,
+//   - a call site reads it before and after the call, so the time spent in
+//     library calls like printf or memcpy shows up on its own.
+// The pass writes the id -> source line mapping, taken from the same debug
+// info as getSourceCodeLine, to -bbprofile-map for bbprof_report.py.
+// Modules are told apart in the table by their source file name, which
+// survives piping the bitcode through opt, or by -bbprofile-module.
+
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include <cxxabi.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace llvm;
+using namespace std;
+
+// Strings for output
+std::string output_str;
+raw_string_ostream output(output_str);
+
+static cl::opt<string> MapFile("bbprofile-map", cl::init("bbprofile.map"),
+                               cl::desc("Write the counter id to source line map here"));
+
+static cl::opt<string> ModuleName("bbprofile-module", cl::init(""),
+                                  cl::desc("Name of the module in the counter table "
+                                           "(default: its source file name)"));
+
+namespace {
+class BBProfile : public ModulePass {
+public:
+  static char ID;
+
+  BBProfile() : ModulePass(ID) {}
+
+  bool runOnModule(Module &M) override {
+    std::error_code EC;
+    raw_fd_ostream map(MapFile, EC, sys::fs::OF_Text);
+    if (EC) {
+      errs() << "Cannot write " << MapFile << ": " << EC.message() << "\n";
+      return false;
+    }
+
+    LLVMContext &C = M.getContext();
+    int64Ty = Type::getInt64Ty(C);
+
+    // Collect the sites first, the counter table size depends on them
+    vector<BasicBlock *> blocks;
+    vector<CallInst *> calls;
+    for (Function &F : M) {
+      if (F.isDeclaration() || F.getName().startswith("__bbprof")) {
+        continue;
+      }
+      for (BasicBlock &b : F) {
+        blocks.push_back(&b);
+        for (Instruction &I : b) {
+          CallInst *callInst = dyn_cast<CallInst>(&I);
+          if (callInst && !isa<IntrinsicInst>(callInst) && !callInst->isInlineAsm()) {
+            calls.push_back(callInst);
+          }
+        }
+      }
+    }
+    uint64_t numCounters = blocks.size() + calls.size();
+    if (!numCounters) {
+      return false;
+    }
+
+    string name = getTableName(M);
+    createTable(M, name, numCounters);
+    readCycles = Intrinsic::getDeclaration(&M, Intrinsic::readcyclecounter);
+
+    map << "# module " << name << " " << numCounters << "\n";
+    uint64_t id = 0;
+    for (BasicBlock *b : blocks) {
+      Instruction *located = nullptr;
+      for (Instruction &I : *b) {
+        if (getSourceCodeLine(&I) > 0) {
+          located = &I;
+          break;
+        }
+      }
+      writeMapEntry(map, id, "bb", b->getParent(), located);
+      instrumentBlock(b, id++);
+    }
+    for (CallInst *callInst : calls) {
+      Function *callee = callInst->getCalledFunction();
+      string kind = "call " + (callee ? demangle(callee->getName().str().c_str())
+                                      : string("<indirect>"));
+      writeMapEntry(map, id, kind, callInst->getFunction(), callInst);
+      instrumentCall(callInst, id++);
+    }
+
+    output << name << ": " << blocks.size() << " blocks, "
+           << calls.size() << " call sites profiled\n";
+    errs() << output.str();
+    output.flush();
+
+    cleanGlobalVariables();
+    return true;
+  }
+
+private:
+  Type *int64Ty;
+  Function *readCycles;
+  GlobalVariable *table;
+
+  // Name of the module in the table, which has room for 63 characters. A
+  // longer name keeps its end, after a hash of the whole name.
+  string getTableName(Module &M) {
+    string name = ModuleName.empty() ? M.getSourceFileName() : ModuleName.getValue();
+    if (name.empty()) {
+      name = M.getModuleIdentifier();
+    }
+    if (name.size() > 63) {
+      name = utohexstr(xxHash64(name)) + ":" + name.substr(name.size() - 46);
+    }
+    return name;
+  }
+
+  // The module's slice of the shared table. It points at a private zeroed
+  // array until __bbprof_register runs, so code running before the
+  // constructor still has somewhere to count.
+  void createTable(Module &M, const string &name, uint64_t numCounters) {
+    LLVMContext &C = M.getContext();
+    ArrayType *arrayTy = ArrayType::get(int64Ty, 2 * numCounters);
+    GlobalVariable *fallback = new GlobalVariable(
+        M, arrayTy, false, GlobalValue::PrivateLinkage,
+        ConstantAggregateZero::get(arrayTy), "__bbprof_fallback");
+
+    PointerType *ptrTy = int64Ty->getPointerTo();
+    table = new GlobalVariable(
+        M, ptrTy, false, GlobalValue::PrivateLinkage,
+        ConstantExpr::getPointerCast(fallback, ptrTy), "__bbprof_table");
+
+    FunctionCallee registerFunc = M.getOrInsertFunction(
+        "__bbprof_register", Type::getVoidTy(C), Type::getInt8PtrTy(C),
+        Type::getInt32Ty(C), ptrTy->getPointerTo());
+    Function *ctor = Function::Create(
+        FunctionType::get(Type::getVoidTy(C), false),
+        GlobalValue::InternalLinkage, "__bbprof_module_ctor", &M);
+    IRBuilder<> builder(BasicBlock::Create(C, "entry", ctor));
+    builder.CreateCall(registerFunc,
+                       {builder.CreateGlobalStringPtr(name),
+                        builder.getInt32(numCounters), table});
+    builder.CreateRetVoid();
+    appendToGlobalCtors(M, ctor, 1);
+  }
+
+  // counters[2 * id] += 1, counters[2 * id + 1] += end - start
+  void addSample(IRBuilder<> &builder, uint64_t id, Value *start) {
+    Value *end = builder.CreateCall(readCycles);
+    Value *counters = builder.CreateLoad(table->getValueType(), table);
+    Value *countPtr = builder.CreateConstInBoundsGEP1_64(int64Ty, counters, 2 * id);
+    Value *cyclesPtr = builder.CreateConstInBoundsGEP1_64(int64Ty, counters, 2 * id + 1);
+    builder.CreateStore(
+        builder.CreateAdd(builder.CreateLoad(int64Ty, countPtr), builder.getInt64(1)),
+        countPtr);
+    builder.CreateStore(
+        builder.CreateAdd(builder.CreateLoad(int64Ty, cyclesPtr),
+                          builder.CreateSub(end, start)),
+        cyclesPtr);
+  }
+
+  void instrumentBlock(BasicBlock *b, uint64_t id) {
+    IRBuilder<> builder(&*b->getFirstInsertionPt());
+    Value *start = builder.CreateCall(readCycles);
+    builder.SetInsertPoint(b->getTerminator());
+    addSample(builder, id, start);
+  }
+
+  void instrumentCall(CallInst *callInst, uint64_t id) {
+    IRBuilder<> builder(callInst);
+    Value *start = builder.CreateCall(readCycles);
+    builder.SetInsertPoint(callInst->getNextNode());
+    addSample(builder, id, start);
+  }
+
+  // "id <TAB> kind <TAB> function <TAB> file:line"
+  void writeMapEntry(raw_ostream &map, uint64_t id, const string &kind,
+                     Function *F, Instruction *I) {
+    string file = "?";
+    int line = -1;
+    if (I) {
+      line = getSourceCodeLine(I);
+      if (DILocation *loc = I->getDebugLoc()) {
+        file = loc->getFilename().str();
+      }
+    }
+    map << id << "\t" << kind << "\t" << demangle(F->getName().str().c_str())
+        << "\t" << file << ":" << line << "\n";
+  }
+
+  // Reset all global variables when a new module is run.
+  void cleanGlobalVariables() {
+    output_str = "";
+  }
+
+  // Demangles the function name.
+  std::string demangle(const char *name) {
+    int status = -1;
+
+    std::unique_ptr<char, void (*)(void *)> res{
+        abi::__cxa_demangle(name, NULL, NULL, &status), std::free};
+    return (status == 0) ? res.get() : std::string(name);
+  }
+
+  // Returns the source code line number cooresponding to the LLVM instruction.
+  // Returns -1 if the instruction has no associated Metadata.
+  int getSourceCodeLine(Instruction *I) {
+    // Get debugInfo associated with every instruction.
+    llvm::DebugLoc debugInfo = I->getDebugLoc();
+
+    int line = -1;
+    if (debugInfo)
+      line = debugInfo.getLine();
+
+    return line;
+  }
+
+}; // BBProfile
+} // namespace
+
+char BBProfile::ID = 0;
+static RegisterPass<BBProfile> X("bbprofile",
+                                 "Pass to count cycles per basic block and call site");
@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+# Map bbprofile counters back to source lines and list the hotspots.
+#
+# Usage: ./bbprof_report.py <table> <map file>... [--top 20] [--execs N]
+#   table  /dev/shm/bbprofile, a BBPROF_OUT dump of one run, or a directory
+#          of such dumps, which are summed
+#   map    files written by -bbprofile-map, one per instrumented module
+# With --execs the cycles are also shown per execution of the harness; for a
+# directory of dumps it defaults to the number of dumps.
+
+import argparse
+import os
+import struct
+from collections import defaultdict
+
+MAGIC = 0x31464f5250424242
+HEADER = struct.Struct('<QIIII')
+MODULE = struct.Struct('<64sII')
+MAX_MODULES = 16
+
+
+def read_table(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    magic, _, used, num_modules, _ = HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        raise SystemExit(f'{path}: not a bbprofile table')
+
+    modules = {}
+    for i in range(num_modules):
+        name, offset, n = MODULE.unpack_from(data, HEADER.size + i * MODULE.size)
+        modules[name.rstrip(b'\0').decode()] = (offset, n)
+
+    start = HEADER.size + MAX_MODULES * MODULE.size
+    counters = struct.unpack_from(f'<{2 * used}Q', data, start)
+    # module -> its (entries, cycles) counters
+    return {name: counters[2 * offset:2 * (offset + n)] for name, (offset, n) in modules.items()}
+
+
+def read_tables(path):
+    if not os.path.isdir(path):
+        return read_table(path), 0
+    # Modules may have registered in another order in every run
+    modules, dumps = {}, sorted(os.listdir(path))
+    for dump in dumps:
+        for name, counters in read_table(os.path.join(path, dump)).items():
+            total = modules.setdefault(name, [0] * len(counters))
+            for i, value in enumerate(counters[:len(total)]):
+                total[i] += value
+    return modules, len(dumps)
+
+
+def read_map(path):
+    module, sites = None, []
+    with open(path) as f:
+        for line in f:
+            if line.startswith('# module '):
+                module = line[len('# module '):].rsplit(' ', 1)[0]
+                continue
+            site_id, kind, func, location = line.rstrip('\n').split('\t')
+            sites.append((int(site_id), kind, func, location))
+    return module, sites
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('table')
+    parser.add_argument('maps', nargs='+')
+    parser.add_argument('--top', type=int, default=20)
+    parser.add_argument('--execs', type=int, default=0)
+    args = parser.parse_args()
+
+    modules, dumps = read_tables(args.table)
+    execs = args.execs or dumps
+
+    # (kind, function, location) -> [entries, cycles]; blocks on the same
+    # line are summed, call sites are kept apart by callee
+    totals = defaultdict(lambda: [0, 0])
+    for path in args.maps:
+        module, sites = read_map(path)
+        key = module[:63]
+        if key not in modules:
+            print(f'{path}: module {module} not in the table, skipped')
+            continue
+        counters = modules[key]
+        for site_id, kind, func, location in sites:
+            entries = counters[2 * site_id]
+            cycles = counters[2 * site_id + 1]
+            total = totals[(kind, func, location)]
+            total[0] += entries
+            total[1] += cycles
+
+    all_cycles = sum(c for (kind, _, _), (_, c) in totals.items() if kind == 'bb')
+    hotspots = sorted(totals.items(), key=lambda item: item[1][1], reverse=True)
+
+    header = f"{'cycles':>14} {'%bb':>6} {'entries':>12} {'cyc/entry':>10}"
+    if execs:
+        header += f" {'cyc/exec':>10}"
+    print(header + '  site')
+    for (kind, func, location), (entries, cycles) in hotspots[:args.top]:
+        line = (f'{cycles:>14} {100.0 * cycles / max(all_cycles, 1):>6.1f} '
+                f'{entries:>12} {cycles // max(entries, 1):>10}')
+        if execs:
+            line += f' {cycles // execs:>10}'
+        print(f'{line}  {location} {func} ({kind})')
+
+
+if __name__ == '__main__':
+    main()
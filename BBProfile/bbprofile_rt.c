@@ -0,0 +1,133 @@
+// Runtime for the bbprofile pass.
+//
+// All counters live in one POSIX shared memory object (BBPROF_SHM, default
+// /bbprofile, i.e. /dev/shm/bbprofile on Linux). Every instrumented module
+// registers its counters by name; a module that is already in the table gets
+// its old slice back, so counts add up over fork server children, persistent
+// loop iterations and separate runs until the object is removed. If BBPROF_OUT
+// is set, the table is instead dumped to that file when the process exits or
+// crashes, and every module starts from zero when it registers, so every dump
+// holds the counts of one run even if the previous run died before its dump.
+//
+// Build this file without fuzzer instrumentation and link it into the target.
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BBPROF_MAGIC 0x31464f5250424242ULL // "BBBPROF1"
+#define MAX_MODULES 16
+#define CAPACITY (1 << 20)
+
+typedef struct {
+  char name[64];
+  uint32_t offset;
+  uint32_t n;
+} ModuleEntry;
+
+// bbprof_report.py reads this layout.
+typedef struct {
+  uint64_t magic;
+  uint32_t capacity;
+  uint32_t used;
+  uint32_t num_modules;
+  uint32_t pad;
+  ModuleEntry modules[MAX_MODULES];
+  uint64_t counters[]; // entries, cycles per id
+} Table;
+
+static Table *table;
+
+static size_t table_size(void) {
+  return sizeof(Table) + 2 * (size_t)CAPACITY * sizeof(uint64_t);
+}
+
+static void dump(void) {
+  const char *path = getenv("BBPROF_OUT");
+  if (!path || !table)
+    return;
+  FILE *f = fopen(path, "wb");
+  if (!f)
+    return;
+  size_t counters = 2 * (size_t)table->used * sizeof(uint64_t);
+  fwrite(table, 1, sizeof(Table) + counters, f);
+  fclose(f);
+  memset(table->counters, 0, counters);
+}
+
+static void crash_handler(int sig) {
+  dump();
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+static void open_table(void) {
+  const char *name = getenv("BBPROF_SHM");
+  int fd = shm_open(name ? name : "/bbprofile", O_RDWR | O_CREAT, 0600);
+  struct stat sb;
+
+  if (fd < 0 || fstat(fd, &sb) ||
+      (sb.st_size < (off_t)table_size() && ftruncate(fd, table_size()))) {
+    perror("bbprofile: shm_open");
+    return;
+  }
+  table = mmap(NULL, table_size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (table == MAP_FAILED) {
+    perror("bbprofile: mmap");
+    table = NULL;
+    return;
+  }
+  if (table->magic != BBPROF_MAGIC) {
+    memset(table, 0, sizeof(Table));
+    table->magic = BBPROF_MAGIC;
+    table->capacity = CAPACITY;
+  }
+  atexit(dump);
+  if (getenv("BBPROF_OUT")) {
+    int signals[] = {SIGABRT, SIGSEGV, SIGBUS, SIGFPE, SIGILL};
+    for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++)
+      signal(signals[i], crash_handler);
+  }
+}
+
+// One run per dump: drop what a crashed run left behind
+static void reset_slice(uint64_t *slice, uint32_t n) {
+  if (getenv("BBPROF_OUT"))
+    memset(slice, 0, 2 * (size_t)n * sizeof(uint64_t));
+}
+
+void __bbprof_register(const char *name, uint32_t n, uint64_t **slice) {
+  if (!table)
+    open_table();
+  if (!table)
+    return;
+
+  for (uint32_t i = 0; i < table->num_modules; i++) {
+    ModuleEntry *m = &table->modules[i];
+    if (!strncmp(m->name, name, sizeof(m->name) - 1) && m->n == n) {
+      *slice = &table->counters[2 * (size_t)m->offset];
+      reset_slice(*slice, n);
+      return;
+    }
+  }
+
+  if (table->num_modules == MAX_MODULES || table->used + n > table->capacity) {
+    fprintf(stderr, "bbprofile: table full, %s is not profiled\n", name);
+    return;
+  }
+  ModuleEntry *m = &table->modules[table->num_modules++];
+  strncpy(m->name, name, sizeof(m->name) - 1);
+  m->offset = table->used;
+  m->n = n;
+  table->used += n;
+  *slice = &table->counters[2 * (size_t)m->offset];
+  reset_slice(*slice, n);
+}
@@ -0,0 +1,19 @@
+#!/bin/bash
+# Build a cycle-profiled fuzz target, run it on every input once and list
+# the per-exec hotspots.
+# Usage: ./run.sh <target .c> <input dir>
+name=$(basename "$1" .c)
+clang -O0 -g -emit-llvm -c "$1" -o "$name.bc"
+opt -enable-new-pm=0 -load ~/llvm-project/build/lib/BBProfile.so -bbprofile -bbprofile-module="$(realpath "$1")" -bbprofile-map="$name.map" < "$name.bc" > "$name.prof.bc"
+
+# The runtime must not be profiled itself
+clang -O2 -c bbprofile_rt.c -o bbprofile_rt.o
+clang -O2 "$name.prof.bc" bbprofile_rt.o -o "$name.prof"
+
+# One dump per input, the report sums them
+rm -rf /dev/shm/bbprofile "profile_$name"
+mkdir "profile_$name"
+for input in "$2"/*; do
+  BBPROF_OUT="profile_$name/$(basename "$input")" "./$name.prof" "$(cat "$input")" > /dev/null
+done
+./bbprof_report.py "profile_$name" "$name.map"
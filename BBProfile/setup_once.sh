@@ -0,0 +1,6 @@
+#!/bin/bash
+LLVM_TRANSFORMS_DIR="$HOME/llvm-project/llvm/lib/Transforms"
+ASSIGNMENT="BBProfile"
+ASSIGNMENT_DIR="$LLVM_TRANSFORMS_DIR/$ASSIGNMENT"
+
+echo "add_subdirectory($ASSIGNMENT)" >> $LLVM_TRANSFORMS_DIR/CMakeLists.txt
\ No newline at end of file
@@ -0,0 +1,379 @@
+// Comparison splitting (laf-intel style) for fuzz targets.
+//
+// Coverage-guided fuzzers only see edges, so a 32-bit compare or a strcmp is a
+// single coin flip to them. This pass rewrites every such comparison into a
+// chain of single-byte compares, each with its own basic block, so that every
+// matching byte is rewarded with a new edge:
+//   1. strcmp/strncmp/memcmp against a constant string are unrolled byte by byte.
+//   2. switch statements become a chain of equality compares.
+//   3. integer compares wider than one byte are split from the most significant
+//      byte down; one-byte compares whose result is only used as data (e.g.
+//      folded into a flag or a select) are turned into branches as well.
+
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cxxabi.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace llvm;
+using namespace std;
+
+// Strings for output
+std::string output_str;
+raw_string_ostream output(output_str);
+
+// Longest constant string that strcmp/memcmp calls are unrolled for.
+static const unsigned MaxUnrollBytes = 64;
+
+namespace {
+class CompareSplit : public FunctionPass {
+public:
+  static char ID;
+
+  CompareSplit() : FunctionPass(ID) {}
+
+  bool runOnFunction(Function &F) override {
+    if (F.isDeclaration())
+      return false;
+
+    int splitCalls = 0, splitSwitches = 0, splitCompares = 0;
+
+    // 1. Calls to the string compare functions
+    vector<CallInst *> calls;
+    for (Instruction &I : instructions(F))
+      if (CallInst *callInst = dyn_cast<CallInst>(&I))
+        calls.push_back(callInst);
+    for (CallInst *callInst : calls)
+      splitCalls += splitStringCompare(callInst);
+
+    // 2. Switch statements
+    vector<SwitchInst *> switches;
+    for (BasicBlock &b : F)
+      if (SwitchInst *switchInst = dyn_cast<SwitchInst>(b.getTerminator()))
+        switches.push_back(switchInst);
+    for (SwitchInst *switchInst : switches)
+      splitSwitches += splitSwitch(switchInst);
+
+    // 3. Integer compares, including the ones created above
+    vector<ICmpInst *> compares;
+    for (Instruction &I : instructions(F))
+      if (ICmpInst *cmpInst = dyn_cast<ICmpInst>(&I))
+        compares.push_back(cmpInst);
+    for (ICmpInst *cmpInst : compares)
+      splitCompares += splitIntCompare(cmpInst);
+
+    bool changed = splitCalls || splitSwitches || splitCompares;
+    if (changed) {
+      output << demangle(F.getName().str().c_str()) << ": " << splitCalls
+             << " calls, " << splitSwitches << " switches, " << splitCompares
+             << " compares split\n";
+    }
+
+    // Print output
+    errs() << output.str();
+    output.flush();
+
+    cleanGlobalVariables();
+    return changed;
+  }
+
+private:
+  // Unroll strcmp/strncmp/memcmp with one constant string argument into a
+  // chain of byte compares that computes the same result.
+  bool splitStringCompare(CallInst *callInst) {
+    Function *callee = callInst->getCalledFunction();
+    if (!callee || !callInst->getType()->isIntegerTy(32))
+      return false;
+
+    StringRef name = callee->getName();
+    bool isStrcmp = name == "strcmp";
+    bool isSized = name == "strncmp" || name == "memcmp";
+    if (!isStrcmp && !isSized)
+      return false;
+
+    Value *lhs = callInst->getArgOperand(0);
+    Value *rhs = callInst->getArgOperand(1);
+    StringRef lhsStr, rhsStr;
+    bool lhsConst = getConstantStringInfo(lhs, lhsStr, 0, false);
+    bool rhsConst = getConstantStringInfo(rhs, rhsStr, 0, false);
+    // Two constant strings give the fuzzer nothing to match, and `count`
+    // below is only bounded by one of them.
+    if (lhsConst == rhsConst)
+      return false;
+    StringRef str = rhsConst ? rhsStr : lhsStr;
+
+    // Number of bytes the call can look at.
+    uint64_t count;
+    if (name == "memcmp") {
+      ConstantInt *size = dyn_cast<ConstantInt>(callInst->getArgOperand(2));
+      if (!size || size->getZExtValue() > str.size())
+        return false;
+      count = size->getZExtValue();
+    } else {
+      size_t nul = str.find('\0');
+      if (nul == StringRef::npos)
+        return false;
+      count = nul + 1;
+      if (isSized) {
+        ConstantInt *size = dyn_cast<ConstantInt>(callInst->getArgOperand(2));
+        if (!size)
+          return false;
+        count = min<uint64_t>(count, size->getZExtValue());
+      }
+    }
+    if (count == 0 || count > MaxUnrollBytes)
+      return false;
+
+    LLVMContext &C = callInst->getContext();
+    Type *int8Ty = Type::getInt8Ty(C);
+    Type *int32Ty = Type::getInt32Ty(C);
+    BasicBlock *head = callInst->getParent();
+    Function *F = head->getParent();
+
+    BasicBlock *end = head->splitBasicBlock(callInst, "strcmp.end");
+    head->getTerminator()->eraseFromParent();
+    PHINode *result = PHINode::Create(int32Ty, count + 1, "strcmp.res", callInst);
+
+    IRBuilder<> builder(head);
+    Value *lhsPtr = builder.CreatePointerCast(lhs, builder.getInt8PtrTy());
+    Value *rhsPtr = builder.CreatePointerCast(rhs, builder.getInt8PtrTy());
+
+    BasicBlock *prev = head;
+    for (uint64_t i = 0; i < count; i++) {
+      BasicBlock *byteBB = BasicBlock::Create(C, "strcmp.byte", F, end);
+      if (i == 0)
+        builder.CreateBr(byteBB);
+      else
+        cast<BranchInst>(prev->getTerminator())->setSuccessor(1, byteBB);
+
+      builder.SetInsertPoint(byteBB);
+      Value *a = lhsConst ? (Value *)builder.getInt8(lhsStr[i])
+                          : loadByte(builder, int8Ty, lhsPtr, i);
+      Value *b = rhsConst ? (Value *)builder.getInt8(rhsStr[i])
+                          : loadByte(builder, int8Ty, rhsPtr, i);
+      Value *diff = builder.CreateSub(builder.CreateZExt(a, int32Ty),
+                                      builder.CreateZExt(b, int32Ty));
+      Value *ne = builder.CreateICmpNE(a, b);
+      // The false successor is patched to the next byte or to the match block.
+      builder.CreateCondBr(ne, end, end);
+      result->addIncoming(diff, byteBB);
+      prev = byteBB;
+    }
+
+    BasicBlock *matchBB = BasicBlock::Create(C, "strcmp.match", F, end);
+    cast<BranchInst>(prev->getTerminator())->setSuccessor(1, matchBB);
+    BranchInst::Create(end, matchBB);
+    result->addIncoming(ConstantInt::get(int32Ty, 0), matchBB);
+
+    callInst->replaceAllUsesWith(result);
+    callInst->eraseFromParent();
+    return true;
+  }
+
+  Value *loadByte(IRBuilder<> &builder, Type *int8Ty, Value *ptr, uint64_t i) {
+    Value *gep = builder.CreateConstInBoundsGEP1_64(int8Ty, ptr, i);
+    return builder.CreateLoad(int8Ty, gep);
+  }
+
+  // Replace a switch on a multi-byte value by a chain of equality compares,
+  // which splitIntCompare then breaks down into bytes.
+  bool splitSwitch(SwitchInst *switchInst) {
+    Value *cond = switchInst->getCondition();
+    IntegerType *condTy = dyn_cast<IntegerType>(cond->getType());
+    if (!condTy || condTy->getBitWidth() <= 8 || switchInst->getNumCases() == 0)
+      return false;
+
+    LLVMContext &C = switchInst->getContext();
+    BasicBlock *head = switchInst->getParent();
+    Function *F = head->getParent();
+    BasicBlock *defaultBB = switchInst->getDefaultDest();
+
+    // Remember what each successor's PHIs received from the switch block.
+    unordered_map<PHINode *, Value *> phiValues;
+    for (BasicBlock *succ : successors(head)) {
+      for (PHINode &phi : succ->phis()) {
+        if (phiValues.count(&phi))
+          continue;
+        phiValues[&phi] = phi.getIncomingValueForBlock(head);
+        while (phi.getBasicBlockIndex(head) >= 0)
+          phi.removeIncomingValue(head, false);
+      }
+    }
+
+    vector<BasicBlock *> caseBBs;
+    for (auto &c : switchInst->cases()) {
+      BasicBlock *caseBB = BasicBlock::Create(C, "switch.case", F, defaultBB);
+      caseBBs.push_back(caseBB);
+      ICmpInst *eq = new ICmpInst(*caseBB, ICmpInst::ICMP_EQ, cond,
+                                  c.getCaseValue(), "switch.eq");
+      // The false successor is patched to the next case below.
+      BranchInst::Create(c.getCaseSuccessor(), defaultBB, eq, caseBB);
+    }
+    for (size_t i = 0; i + 1 < caseBBs.size(); i++)
+      cast<BranchInst>(caseBBs[i]->getTerminator())->setSuccessor(1, caseBBs[i + 1]);
+
+    switchInst->eraseFromParent();
+    BranchInst::Create(caseBBs[0], head);
+
+    // One PHI entry per new incoming edge.
+    for (BasicBlock *caseBB : caseBBs)
+      for (BasicBlock *succ : successors(caseBB))
+        for (PHINode &phi : succ->phis())
+          if (phiValues.count(&phi))
+            phi.addIncoming(phiValues[&phi], caseBB);
+    return true;
+  }
+
+  // The byte-wide operands of an equality compare whose sides are both
+  // extended from i8, e.g. `(int)c != (int)s[i]` in C. Returns false if the
+  // compare cannot be narrowed.
+  bool narrowOperands(ICmpInst *cmpInst, Value *narrow[2]) {
+    if (!cmpInst->isEquality())
+      return false;
+
+    Value *ops[2] = {cmpInst->getOperand(0), cmpInst->getOperand(1)};
+    narrow[0] = narrow[1] = nullptr;
+    int extKind = 0; // 1 = sext, 2 = zext
+    for (int i = 0; i < 2; i++) {
+      if (CastInst *cast = dyn_cast<CastInst>(ops[i])) {
+        int kind = isa<SExtInst>(cast) ? 1 : isa<ZExtInst>(cast) ? 2 : 0;
+        if (!kind || !cast->getSrcTy()->isIntegerTy(8) ||
+            (extKind && extKind != kind))
+          return false;
+        extKind = kind;
+        narrow[i] = cast->getOperand(0);
+      }
+    }
+    if (!extKind)
+      return false;
+
+    Type *int8Ty = Type::getInt8Ty(cmpInst->getContext());
+    for (int i = 0; i < 2; i++) {
+      if (narrow[i])
+        continue;
+      ConstantInt *constant = dyn_cast<ConstantInt>(ops[i]);
+      if (!constant)
+        return false;
+      bool fits = extKind == 1 ? constant->getValue().isSignedIntN(8)
+                               : constant->getValue().isIntN(8);
+      if (!fits)
+        return false;
+      narrow[i] = ConstantInt::get(int8Ty, constant->getValue().trunc(8));
+    }
+    return true;
+  }
+
+  bool feedsOnlyBranches(ICmpInst *cmpInst) {
+    for (User *user : cmpInst->users())
+      if (!isa<BranchInst>(user))
+        return false;
+    return true;
+  }
+
+  // Split an integer compare into per-byte compares, most significant byte
+  // first. The first differing byte decides the result; if all bytes are
+  // equal the result is whether the predicate includes equality.
+  bool splitIntCompare(ICmpInst *cmpInst) {
+    // The IR is left alone until the compare is certain to be split.
+    Value *lhs = cmpInst->getOperand(0);
+    Value *rhs = cmpInst->getOperand(1);
+    Value *narrow[2];
+    if (narrowOperands(cmpInst, narrow)) {
+      lhs = narrow[0];
+      rhs = narrow[1];
+    }
+
+    IntegerType *opTy = dyn_cast<IntegerType>(lhs->getType());
+    if (!opTy || opTy->getBitWidth() % 8)
+      return false;
+    unsigned bytes = opTy->getBitWidth() / 8;
+    if (bytes == 1 && feedsOnlyBranches(cmpInst))
+      return false;
+
+    LLVMContext &C = cmpInst->getContext();
+    Type *int8Ty = Type::getInt8Ty(C);
+    BasicBlock *head = cmpInst->getParent();
+    Function *F = head->getParent();
+    ICmpInst::Predicate pred = cmpInst->getPredicate();
+
+    BasicBlock *end = head->splitBasicBlock(cmpInst, "cmp.end");
+    head->getTerminator()->eraseFromParent();
+    PHINode *result =
+        PHINode::Create(cmpInst->getType(), bytes + 1, "cmp.res", cmpInst);
+
+    IRBuilder<> builder(head);
+    BasicBlock *prev = head;
+    for (int i = bytes - 1; i >= 0; i--) {
+      BasicBlock *byteBB = BasicBlock::Create(C, "cmp.byte", F, end);
+      if (prev == head)
+        builder.CreateBr(byteBB);
+      else
+        cast<BranchInst>(prev->getTerminator())->setSuccessor(1, byteBB);
+
+      builder.SetInsertPoint(byteBB);
+      Value *a = extractByte(builder, int8Ty, lhs, i);
+      Value *b = extractByte(builder, int8Ty, rhs, i);
+
+      // Only the most significant byte carries the sign.
+      ICmpInst::Predicate bytePred = ICmpInst::getStrictPredicate(pred);
+      if (ICmpInst::isSigned(pred) && i != (int)bytes - 1)
+        bytePred = ICmpInst::getUnsignedPredicate(bytePred);
+      Value *decided = cmpInst->isEquality()
+                           ? (Value *)builder.getInt1(pred == ICmpInst::ICMP_NE)
+                           : builder.CreateICmp(bytePred, a, b);
+
+      Value *ne = builder.CreateICmpNE(a, b);
+      // The false successor is patched to the next byte or to the equal block.
+      builder.CreateCondBr(ne, end, end);
+      result->addIncoming(decided, byteBB);
+      prev = byteBB;
+    }
+
+    BasicBlock *equalBB = BasicBlock::Create(C, "cmp.equal", F, end);
+    cast<BranchInst>(prev->getTerminator())->setSuccessor(1, equalBB);
+    BranchInst::Create(end, equalBB);
+    bool inclusive = pred == ICmpInst::ICMP_EQ || ICmpInst::isNonStrictPredicate(pred);
+    result->addIncoming(ConstantInt::get(cmpInst->getType(), inclusive), equalBB);
+
+    cmpInst->replaceAllUsesWith(result);
+    cmpInst->eraseFromParent();
+    return true;
+  }
+
+  Value *extractByte(IRBuilder<> &builder, Type *int8Ty, Value *value, int i) {
+    if (i)
+      value = builder.CreateLShr(value, i * 8);
+    return builder.CreateTrunc(value, int8Ty);
+  }
+
+  // Reset all global variables when a new function is called.
+  void cleanGlobalVariables() {
+    output_str = "";
+  }
+
+  // Demangles the function name.
+  std::string demangle(const char *name) {
+    int status = -1;
+
+    std::unique_ptr<char, void (*)(void *)> res{
+        abi::__cxa_demangle(name, NULL, NULL, &status), std::free};
+    return (status == 0) ? res.get() : std::string(name);
+  }
+
+}; // CompareSplit
+} // namespace
+
+char CompareSplit::ID = 0;
+static RegisterPass<CompareSplit> X("splitcompares",
+                                    "Pass to split compares into single bytes");
@@ -0,0 +1,22 @@
+#!/bin/bash
+# Build a fuzz target with and without split compares, fuzz both for the same
+# time and print their throughput and coverage. The targets compare argv[1],
+# so both run through ../Assignment3/ArgvShim with the test case as argv[1].
+# Usage: ./run.sh <target .c> <input dir> <seconds>
+name=$(basename "$1" .c)
+inputs=$(realpath "$2")
+clang -O1 -g -S -emit-llvm -fno-discard-value-names -o "$name.ll" -c "$1"
+opt -enable-new-pm=0 -load ~/llvm-project/build/lib/CompareSplit.so -splitcompares -S < "$name.ll" > "$name.split.ll"
+
+shim=$(realpath ../Assignment3/ArgvShim)
+for bin in "$name" "$name.split"; do
+  # -O0 so the split chains are not folded back into selects
+  (cd "$shim" && ./build.sh "$OLDPWD/$bin" -O0 "$OLDPWD/$bin.ll") || exit 1
+done
+
+for bin in "$name" "$name.split"; do
+  rm -rf "output_$bin"
+  AFL_PRELOAD="$shim/argv_shim.so" AFL_PERSISTENT=1 AFL_DEFER_FORKSRV=1 AFL_NO_UI=1 \
+    afl-fuzz -V "$3" -i "$inputs" -o "output_$bin" -m none -- "./$bin" > /dev/null
+  echo "$bin: $(grep -E 'execs_per_sec|edges_found' output_$bin/default/fuzzer_stats | tr -s ' ' | tr '\n' ' ')"
+done
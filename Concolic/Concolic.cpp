@@ -0,0 +1,391 @@
+// Instrumentation for the concolic seed generator (concolic.py).
+//
+// The instrumented target runs concretely, but every integer value also gets
+// a shadow: the id of an expression over one input byte in concolic_rt.c, or
+// 0 if the value does not depend on the input. The pass inserts
+//   - __concolic_expr after arithmetic, comparisons and casts on integers,
+//   - __concolic_load / __concolic_store (and memcpy/memset) so shadows flow
+//     through memory, kept per byte by the runtime,
+//   - __concolic_set_arg / get_arg / set_ret / get_ret so they flow through
+//     calls between instrumented functions,
+//   - __concolic_branch / __concolic_switch before every branch on a
+//     symbolic condition; these are the path constraints of the trace,
+//   - __concolic_main at the entry of main, which makes argv[CONCOLIC_ARG]
+//     the symbolic input.
+// Shadows of values that are constants in the IR are the constant 0 here,
+// so code that never touches the input only pays for loads and stores.
+
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace llvm;
+using namespace std;
+
+// Strings for output
+std::string output_str;
+raw_string_ostream output(output_str);
+
+namespace {
+
+// Expression operators, the same numbers as OPS in concolic.py
+enum ExprOp {
+  OpInput, OpAdd, OpSub, OpMul, OpUDiv, OpSDiv, OpURem, OpSRem, OpShl, OpLShr,
+  OpAShr, OpAnd, OpOr, OpXor, OpZExt, OpSExt, OpTrunc, OpEq, OpNe, OpUgt,
+  OpUge, OpUlt, OpUle, OpSgt, OpSge, OpSlt, OpSle
+};
+
+class Concolic : public ModulePass {
+public:
+  static char ID;
+
+  Concolic() : ModulePass(ID) {}
+
+  bool runOnModule(Module &M) override {
+    LLVMContext &C = M.getContext();
+    int32Ty = Type::getInt32Ty(C);
+    int64Ty = Type::getInt64Ty(C);
+    int8PtrTy = Type::getInt8PtrTy(C);
+    zero = ConstantInt::get(int32Ty, 0);
+    Type *voidTy = Type::getVoidTy(C);
+
+    mainFunc = M.getOrInsertFunction("__concolic_main", voidTy, int32Ty,
+                                     int8PtrTy->getPointerTo());
+    exprFunc = M.getOrInsertFunction("__concolic_expr", int32Ty, int32Ty, int32Ty,
+                                     int32Ty, int64Ty, int32Ty, int64Ty);
+    loadFunc = M.getOrInsertFunction("__concolic_load", int32Ty, int8PtrTy, int32Ty);
+    storeFunc = M.getOrInsertFunction("__concolic_store", voidTy, int8PtrTy,
+                                      int32Ty, int32Ty);
+    memcpyFunc = M.getOrInsertFunction("__concolic_memcpy", voidTy, int8PtrTy,
+                                       int8PtrTy, int64Ty);
+    clearFunc = M.getOrInsertFunction("__concolic_clear", voidTy, int8PtrTy, int64Ty);
+    branchFunc = M.getOrInsertFunction("__concolic_branch", voidTy, int32Ty,
+                                       int32Ty, int32Ty);
+    switchFunc = M.getOrInsertFunction("__concolic_switch", voidTy, int32Ty, int32Ty,
+                                       int32Ty, int64Ty, int64Ty->getPointerTo(),
+                                       int32Ty);
+    setArgFunc = M.getOrInsertFunction("__concolic_set_arg", voidTy, int32Ty,
+                                       int32Ty, int64Ty);
+    getArgFunc = M.getOrInsertFunction("__concolic_get_arg", int32Ty, int32Ty, int64Ty);
+    setRetFunc = M.getOrInsertFunction("__concolic_set_ret", voidTy, int32Ty, int64Ty);
+    getRetFunc = M.getOrInsertFunction("__concolic_get_ret", int32Ty, int64Ty);
+
+    unsigned numFunctions = 0;
+    for (Function &F : M) {
+      if (F.isDeclaration() || F.getName().startswith("__concolic")) {
+        continue;
+      }
+      instrumentFunction(F);
+      numFunctions++;
+    }
+
+    output << M.getModuleIdentifier() << ": " << numFunctions << " functions, "
+           << numSites << " branch sites instrumented\n";
+    errs() << output.str();
+    output.flush();
+
+    cleanGlobalVariables();
+    return true;
+  }
+
+private:
+  Type *int32Ty, *int64Ty, *int8PtrTy;
+  Constant *zero;
+  FunctionCallee mainFunc, exprFunc, loadFunc, storeFunc, memcpyFunc, clearFunc,
+      branchFunc, switchFunc, setArgFunc, getArgFunc, setRetFunc, getRetFunc;
+
+  // Value -> shadow expression id (i32) in the current function
+  unordered_map<Value *, Value *> shadows;
+  // Shadow phis are filled in once all incoming values have shadows
+  vector<pair<PHINode *, PHINode *>> shadowPhis;
+  unsigned numSites = 0;
+
+  Value *getShadow(Value *V) {
+    auto it = shadows.find(V);
+    return it == shadows.end() ? zero : it->second;
+  }
+
+  bool isSymbolic(Value *shadow) { return shadow != zero; }
+
+  // Integers the runtime can evaluate: up to 64 bits
+  bool isTracked(Type *type) {
+    return type->isIntegerTy() && type->getIntegerBitWidth() <= 64;
+  }
+
+  Value *toInt64(IRBuilder<> &builder, Value *V) {
+    return builder.CreateZExtOrTrunc(V, int64Ty);
+  }
+
+  void instrumentFunction(Function &F) {
+    // Visit blocks in reverse post order so definitions come before uses,
+    // except for the incoming values of phis
+    vector<Instruction *> instructions;
+    ReversePostOrderTraversal<Function *> RPOT(&F);
+    for (BasicBlock *b : RPOT) {
+      for (Instruction &I : *b) {
+        instructions.push_back(&I);
+      }
+    }
+
+    IRBuilder<> builder(&*F.getEntryBlock().getFirstInsertionPt());
+    if (F.getName() == "main" && F.arg_size() == 2) {
+      Argument *argc = F.getArg(0);
+      Argument *argv = F.getArg(1);
+      if (argc->getType() == int32Ty && argv->getType() == int8PtrTy->getPointerTo()) {
+        builder.CreateCall(mainFunc, {argc, argv});
+      }
+    } else {
+      for (Argument &arg : F.args()) {
+        if (isTracked(arg.getType())) {
+          shadows[&arg] = builder.CreateCall(
+              getArgFunc, {builder.getInt32(arg.getArgNo()), toInt64(builder, &arg)});
+        }
+      }
+    }
+
+    for (Instruction *I : instructions) {
+      instrumentInstruction(I);
+    }
+
+    for (auto &entry : shadowPhis) {
+      PHINode *phi = entry.first;
+      for (unsigned i = 0; i < phi->getNumIncomingValues(); i++) {
+        entry.second->addIncoming(getShadow(phi->getIncomingValue(i)),
+                                  phi->getIncomingBlock(i));
+      }
+    }
+
+    shadows.clear();
+    shadowPhis.clear();
+  }
+
+  void instrumentInstruction(Instruction *I) {
+    // Binary Operator
+    if (BinaryOperator *binOp = dyn_cast<BinaryOperator>(I)) {
+      int op = getBinaryOp(binOp->getOpcode());
+      if (op >= 0 && isTracked(I->getType())) {
+        addExpr(I, op, I->getType()->getIntegerBitWidth(), I->getOperand(0),
+                I->getOperand(1));
+      }
+    }
+
+    // Comparison on integers, the width is the one of the operands
+    else if (ICmpInst *cmpInst = dyn_cast<ICmpInst>(I)) {
+      Type *type = cmpInst->getOperand(0)->getType();
+      if (isTracked(type)) {
+        addExpr(I, getCmpOp(cmpInst->getPredicate()), type->getIntegerBitWidth(),
+                cmpInst->getOperand(0), cmpInst->getOperand(1));
+      }
+    }
+
+    // Casts between integers
+    else if (isa<ZExtInst>(I) || isa<SExtInst>(I) || isa<TruncInst>(I)) {
+      if (isTracked(I->getType()) && isTracked(I->getOperand(0)->getType())) {
+        int op = isa<ZExtInst>(I) ? OpZExt : isa<SExtInst>(I) ? OpSExt : OpTrunc;
+        addExpr(I, op, I->getType()->getIntegerBitWidth(), I->getOperand(0), nullptr);
+      }
+    }
+
+    // Phi and Select pick the shadow of the value they pick
+    else if (PHINode *phi = dyn_cast<PHINode>(I)) {
+      if (isTracked(I->getType())) {
+        PHINode *shadowPhi = PHINode::Create(int32Ty, phi->getNumIncomingValues(),
+                                             "", phi->getNextNode());
+        shadows[I] = shadowPhi;
+        shadowPhis.push_back({phi, shadowPhi});
+      }
+    } else if (SelectInst *select = dyn_cast<SelectInst>(I)) {
+      Value *trueShadow = getShadow(select->getTrueValue());
+      Value *falseShadow = getShadow(select->getFalseValue());
+      if (isTracked(I->getType()) && (isSymbolic(trueShadow) || isSymbolic(falseShadow))) {
+        IRBuilder<> builder(select->getNextNode());
+        shadows[I] = builder.CreateSelect(select->getCondition(), trueShadow, falseShadow);
+      }
+    }
+
+    // Load Instruction
+    else if (LoadInst *loadInst = dyn_cast<LoadInst>(I)) {
+      if (isTracked(I->getType())) {
+        IRBuilder<> builder(loadInst->getNextNode());
+        shadows[I] = builder.CreateCall(
+            loadFunc, {builder.CreatePointerCast(loadInst->getPointerOperand(), int8PtrTy),
+                       builder.getInt32(getSize(I->getType()))});
+      }
+    }
+
+    // Store Instruction, also with a concrete value to clear old shadows
+    else if (StoreInst *storeInst = dyn_cast<StoreInst>(I)) {
+      Value *value = storeInst->getValueOperand();
+      if (isTracked(value->getType())) {
+        IRBuilder<> builder(storeInst);
+        builder.CreateCall(
+            storeFunc, {builder.CreatePointerCast(storeInst->getPointerOperand(), int8PtrTy),
+                        builder.getInt32(getSize(value->getType())), getShadow(value)});
+      }
+    }
+
+    // Memory intrinsics move or overwrite shadows
+    else if (MemTransferInst *transfer = dyn_cast<MemTransferInst>(I)) {
+      IRBuilder<> builder(transfer);
+      builder.CreateCall(memcpyFunc,
+                         {builder.CreatePointerCast(transfer->getRawDest(), int8PtrTy),
+                          builder.CreatePointerCast(transfer->getRawSource(), int8PtrTy),
+                          toInt64(builder, transfer->getLength())});
+    } else if (MemSetInst *memSet = dyn_cast<MemSetInst>(I)) {
+      IRBuilder<> builder(memSet);
+      builder.CreateCall(clearFunc,
+                         {builder.CreatePointerCast(memSet->getRawDest(), int8PtrTy),
+                          toInt64(builder, memSet->getLength())});
+    }
+
+    // Call Instruction
+    else if (CallInst *callInst = dyn_cast<CallInst>(I)) {
+      instrumentCall(callInst);
+    }
+
+    // Return Instruction
+    else if (ReturnInst *retInst = dyn_cast<ReturnInst>(I)) {
+      Value *value = retInst->getReturnValue();
+      if (value && isTracked(value->getType()) && isSymbolic(getShadow(value))) {
+        IRBuilder<> builder(retInst);
+        builder.CreateCall(setRetFunc, {getShadow(value), toInt64(builder, value)});
+      }
+    }
+
+    // Branch Instruction
+    else if (BranchInst *branchInst = dyn_cast<BranchInst>(I)) {
+      if (branchInst->isConditional()) {
+        Value *condition = branchInst->getCondition();
+        Value *shadow = getShadow(condition);
+        if (isSymbolic(shadow)) {
+          IRBuilder<> builder(branchInst);
+          builder.CreateCall(branchFunc, {builder.getInt32(numSites++), shadow,
+                                          builder.CreateZExt(condition, int32Ty)});
+        }
+      }
+    }
+
+    // Switch Instruction, the case values are passed as a constant array
+    else if (SwitchInst *switchInst = dyn_cast<SwitchInst>(I)) {
+      Value *condition = switchInst->getCondition();
+      Value *shadow = getShadow(condition);
+      if (isSymbolic(shadow) && switchInst->getNumCases()) {
+        vector<Constant *> cases;
+        for (auto &c : switchInst->cases()) {
+          cases.push_back(ConstantInt::get(int64Ty, c.getCaseValue()->getZExtValue()));
+        }
+        Module *M = I->getModule();
+        ArrayType *arrayTy = ArrayType::get(int64Ty, cases.size());
+        GlobalVariable *caseArray = new GlobalVariable(
+            *M, arrayTy, true, GlobalValue::PrivateLinkage,
+            ConstantArray::get(arrayTy, cases), "__concolic_cases");
+
+        IRBuilder<> builder(switchInst);
+        builder.CreateCall(
+            switchFunc,
+            {builder.getInt32(numSites++), shadow,
+             builder.getInt32(condition->getType()->getIntegerBitWidth()),
+             toInt64(builder, condition),
+             builder.CreateConstInBoundsGEP2_64(arrayTy, caseArray, 0, 0),
+             builder.getInt32(cases.size())});
+      }
+    }
+  }
+
+  // Shadows of arguments and return values go through the runtime, for
+  // callees defined in this module only
+  void instrumentCall(CallInst *callInst) {
+    Function *callee = callInst->getCalledFunction();
+    if (!callee || callee->isDeclaration() || callInst->isInlineAsm()) {
+      return;
+    }
+
+    IRBuilder<> builder(callInst);
+    for (unsigned i = 0; i < callInst->arg_size(); i++) {
+      Value *arg = callInst->getArgOperand(i);
+      if (isTracked(arg->getType()) && isSymbolic(getShadow(arg))) {
+        builder.CreateCall(setArgFunc,
+                           {builder.getInt32(i), getShadow(arg), toInt64(builder, arg)});
+      }
+    }
+
+    if (isTracked(callInst->getType())) {
+      builder.SetInsertPoint(callInst->getNextNode());
+      shadows[callInst] = builder.CreateCall(getRetFunc, {toInt64(builder, callInst)});
+    }
+  }
+
+  // Adds the expression op(a, b) as the shadow of I, unless both operands
+  // are concrete. b is null for casts.
+  void addExpr(Instruction *I, int op, unsigned width, Value *a, Value *b) {
+    Value *shadowA = getShadow(a);
+    Value *shadowB = b ? getShadow(b) : zero;
+    if (!isSymbolic(shadowA) && !isSymbolic(shadowB)) {
+      return;
+    }
+
+    IRBuilder<> builder(I->getNextNode());
+    Value *concreteB = b ? toInt64(builder, b) : builder.getInt64(0);
+    shadows[I] = builder.CreateCall(
+        exprFunc, {builder.getInt32(op), builder.getInt32(width), shadowA,
+                   toInt64(builder, a), shadowB, concreteB});
+  }
+
+  unsigned getSize(Type *type) { return (type->getIntegerBitWidth() + 7) / 8; }
+
+  int getBinaryOp(unsigned opcode) {
+    switch (opcode) {
+    case Instruction::Add: return OpAdd;
+    case Instruction::Sub: return OpSub;
+    case Instruction::Mul: return OpMul;
+    case Instruction::UDiv: return OpUDiv;
+    case Instruction::SDiv: return OpSDiv;
+    case Instruction::URem: return OpURem;
+    case Instruction::SRem: return OpSRem;
+    case Instruction::Shl: return OpShl;
+    case Instruction::LShr: return OpLShr;
+    case Instruction::AShr: return OpAShr;
+    case Instruction::And: return OpAnd;
+    case Instruction::Or: return OpOr;
+    case Instruction::Xor: return OpXor;
+    default: return -1;
+    }
+  }
+
+  int getCmpOp(CmpInst::Predicate predicate) {
+    switch (predicate) {
+    case CmpInst::ICMP_EQ: return OpEq;
+    case CmpInst::ICMP_NE: return OpNe;
+    case CmpInst::ICMP_UGT: return OpUgt;
+    case CmpInst::ICMP_UGE: return OpUge;
+    case CmpInst::ICMP_ULT: return OpUlt;
+    case CmpInst::ICMP_ULE: return OpUle;
+    case CmpInst::ICMP_SGT: return OpSgt;
+    case CmpInst::ICMP_SGE: return OpSge;
+    case CmpInst::ICMP_SLT: return OpSlt;
+    default: return OpSle;
+    }
+  }
+
+  // Reset all global variables when a new module is run.
+  void cleanGlobalVariables() {
+    numSites = 0;
+    output_str = "";
+  }
+
+}; // Concolic
+} // namespace
+
+char Concolic::ID = 0;
+static RegisterPass<Concolic> X("concolic",
+                                "Pass to record path constraints on input bytes");
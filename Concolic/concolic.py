@@ -0,0 +1,322 @@
+#!/usr/bin/env python3
+# Concolic seed generator running next to AFL++.
+#
+# Follows every new queue entry of the AFL instances in the output directory
+# through a target built with the concolic pass, and for every branch on
+# input bytes in the trace asks for an input taking the other direction:
+# the flipped constraint together with the earlier constraints on the same
+# byte. concolic_rt.c keeps every expression to one input byte, so a query
+# is solved exactly by trying the 256 values of that byte; constraints on
+# other bytes are untouched by the change. Branches on values over several
+# bytes (e.g. an int read from the input) are out of scope: the trace only
+# says they were dropped, they are counted, and --strict stops at the first
+# one so a target can be checked before it is relied on.
+#
+# Queries are collected for a batch of queue entries, deduplicated and
+# looked up in a cache kept across runs (solver_cache.json) before anything
+# is solved. Solutions are written to <output>/<name>/queue with AFL's
+# id:NNNNNN names, where the instances pick them up when they sync (start
+# them with -M/-S).
+#
+# Usage: ./concolic.py -o <afl output dir> [--loop] -- <target.concolic> [fixed args]
+# The test case is passed as the last argument, like ../BBProfile/run.sh.
+
+import argparse
+import hashlib
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+# Operators in the numbering of the pass
+OPS = ['input', 'add', 'sub', 'mul', 'udiv', 'sdiv', 'urem', 'srem', 'shl',
+       'lshr', 'ashr', 'and', 'or', 'xor', 'zext', 'sext', 'trunc', 'eq', 'ne',
+       'ugt', 'uge', 'ult', 'ule', 'sgt', 'sge', 'slt', 'sle']
+CMPS = set(OPS[OPS.index('eq'):])
+
+
+class Node:
+    def __init__(self, op, width, byte, a, b, ca, cb):
+        self.op = OPS[op]
+        self.width = width
+        self.byte = byte
+        self.a, self.b = a, b
+        self.ca, self.cb = ca, cb
+        self.key = None
+
+    # Width of the value of the node, comparisons give one bit
+    def result_width(self):
+        return 1 if self.op in CMPS else self.width
+
+
+def mask(value, width):
+    return value & ((1 << width) - 1)
+
+
+def signed(value, width):
+    value = mask(value, width)
+    return value - (1 << width) if value >> (width - 1) else value
+
+
+def parse_trace(path):
+    nodes, constraints, dropped = {}, [], []
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if fields[0] == 'n' and len(fields) == 9:
+                nodes[int(fields[1])] = Node(*map(int, fields[2:]))
+            elif fields[0] == 'c' and len(fields) == 4 and int(fields[2]) in nodes:
+                constraints.append((int(fields[1]), int(fields[2]), fields[3] == '1'))
+            elif fields[0] == 'd' and len(fields) == 2:
+                dropped.append(int(fields[1]))
+    return nodes, constraints, dropped
+
+
+def expr_key(nodes, id):
+    # Structural form of an expression with its byte as x, shared by all
+    # traces and all positions of the input
+    node = nodes[id]
+    if node.key is None:
+        if node.op == 'input':
+            node.key = 'x'
+        else:
+            a = expr_key(nodes, node.a) if node.a else str(node.ca)
+            b = expr_key(nodes, node.b) if node.b else str(node.cb)
+            node.key = f'({node.op}{node.width} {a} {b})'
+    return node.key
+
+
+def evaluate(nodes, id, x, values):
+    if id in values:
+        return values[id]
+    node = nodes[id]
+    if node.op == 'input':
+        values[id] = x
+        return x
+
+    a = evaluate(nodes, node.a, x, values) if node.a else node.ca
+    b = evaluate(nodes, node.b, x, values) if node.b else node.cb
+    source = nodes[node.a].result_width() if node.a else node.width
+    w = node.width
+    a, b = mask(a, w if node.op not in ('zext', 'sext', 'trunc') else source), mask(b, w)
+    op = node.op
+    if op == 'add':
+        r = a + b
+    elif op == 'sub':
+        r = a - b
+    elif op == 'mul':
+        r = a * b
+    elif op in ('udiv', 'urem', 'sdiv', 'srem') and b == 0:
+        r = 0  # the target traps first, any value will do
+    elif op == 'udiv':
+        r = a // b
+    elif op == 'urem':
+        r = a % b
+    elif op in ('sdiv', 'srem'):
+        sa, sb = signed(a, w), signed(b, w)
+        q = abs(sa) // abs(sb) * (1 if (sa < 0) == (sb < 0) else -1)
+        r = q if op == 'sdiv' else sa - q * sb
+    elif op == 'shl':
+        r = a << b if b < w else 0
+    elif op == 'lshr':
+        r = a >> b if b < w else 0
+    elif op == 'ashr':
+        r = signed(a, w) >> min(b, w - 1)
+    elif op == 'and':
+        r = a & b
+    elif op == 'or':
+        r = a | b
+    elif op == 'xor':
+        r = a ^ b
+    elif op in ('zext', 'trunc'):
+        r = a
+    elif op == 'sext':
+        r = signed(a, source)
+    elif op == 'eq':
+        r = a == b
+    elif op == 'ne':
+        r = a != b
+    elif op in ('ugt', 'uge', 'ult', 'ule'):
+        r = {'ugt': a > b, 'uge': a >= b, 'ult': a < b, 'ule': a <= b}[op]
+    else:
+        sa, sb = signed(a, w), signed(b, w)
+        r = {'sgt': sa > sb, 'sge': sa >= sb, 'slt': sa < sb, 'sle': sa <= sb}[op]
+    r = int(r) if op in CMPS else mask(r, w)
+    values[id] = r
+    return r
+
+
+def queries(nodes, constraints):
+    # (byte, cache key, [(node, required)]) for every flippable constraint
+    by_byte = {}
+    for _, id, taken in constraints:
+        byte = nodes[id].byte
+        prefix = by_byte.setdefault(byte, [])
+        required = prefix + [(id, not taken)]
+        terms = sorted({f'{expr_key(nodes, n)}={int(v)}' for n, v in required})
+        key = hashlib.sha1('&'.join(terms).encode()).hexdigest()
+        yield byte, key, required
+        prefix.append((id, taken))
+
+
+def solve(nodes, required, nul_allowed):
+    # Printable values first, they keep text inputs text
+    candidates = list(range(0x20, 0x7f)) + list(range(1, 0x20)) + list(range(0x7f, 0x100))
+    if nul_allowed:
+        candidates.append(0)
+    for x in candidates:
+        values = {}
+        if all(evaluate(nodes, id, x, values) == int(v) for id, v in required):
+            return x
+    return None
+
+
+class Generator:
+    def __init__(self, args):
+        self.args = args
+        self.dir = os.path.join(args.output, args.name)
+        self.queue = os.path.join(self.dir, 'queue')
+        os.makedirs(self.queue, exist_ok=True)
+        self.cache_path = os.path.join(self.dir, 'solver_cache.json')
+        self.traced_path = os.path.join(self.dir, 'traced')
+
+        self.cache = {}
+        if os.path.exists(self.cache_path):
+            with open(self.cache_path) as f:
+                self.cache = json.load(f)
+        self.traced = set()
+        if os.path.exists(self.traced_path):
+            with open(self.traced_path) as f:
+                self.traced = set(f.read().split('\n')) - {''}
+
+        # Content hashes of what is already in our queue
+        self.written = set()
+        self.next_id = 0
+        for name in os.listdir(self.queue):
+            with open(os.path.join(self.queue, name), 'rb') as f:
+                self.written.add(hashlib.sha1(f.read()).hexdigest())
+            if name.startswith('id:'):
+                self.next_id = max(self.next_id, int(name[3:9]) + 1)
+
+        self.stats = {'traced': 0, 'queries': 0, 'cache_hits': 0, 'solved': 0,
+                      'unsat': 0, 'dropped': 0, 'written': 0}
+
+    def pending(self):
+        entries = []
+        for instance in sorted(os.listdir(self.args.output)):
+            queue = os.path.join(self.args.output, instance, 'queue')
+            if instance == self.args.name or not os.path.isdir(queue):
+                continue
+            for name in sorted(os.listdir(queue)):
+                path = os.path.join(queue, name)
+                if name.startswith('id:') and path not in self.traced:
+                    entries.append(path)
+        return entries
+
+    def trace(self, data, trace_path):
+        # argv cannot hold a NUL, the target sees the bytes before it
+        data = data.split(b'\0')[0]
+        env = dict(os.environ, CONCOLIC_OUT=trace_path,
+                   CONCOLIC_ARG=str(len(self.args.target)))
+        if os.path.exists(trace_path):
+            os.unlink(trace_path)
+        try:
+            subprocess.run(self.args.target + [data], env=env, timeout=self.args.timeout,
+                           stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL,
+                           stderr=subprocess.DEVNULL)
+        except subprocess.TimeoutExpired:
+            pass
+        if not os.path.exists(trace_path):
+            return data, {}, [], []
+        return (data,) + parse_trace(trace_path)
+
+    def run_batch(self, batch, trace_path):
+        # key -> (nodes, required, [(parent path, data, byte)])
+        batch_queries = {}
+        for path in batch:
+            with open(path, 'rb') as f:
+                data, nodes, constraints, dropped = self.trace(f.read(), trace_path)
+            self.stats['traced'] += 1
+            self.stats['dropped'] += len(dropped)
+            if dropped and self.args.strict:
+                sys.exit(f'{path}: branches on several input bytes dropped at sites '
+                         + ' '.join(map(str, sorted(set(dropped)))))
+            for byte, key, required in queries(nodes, constraints):
+                if byte >= len(data):
+                    continue
+                self.stats['queries'] += 1
+                if key not in batch_queries:
+                    batch_queries[key] = (nodes, required, [])
+                batch_queries[key][2].append((path, data, byte))
+
+        for key, (nodes, required, uses) in batch_queries.items():
+            if key in self.cache:
+                self.stats['cache_hits'] += 1
+            else:
+                self.cache[key] = solve(nodes, required, nul_allowed=False)
+            x = self.cache[key]
+            self.stats['solved' if x is not None else 'unsat'] += 1
+            if x is None:
+                continue
+            for path, data, byte in uses:
+                self.write(data[:byte] + bytes([x]) + data[byte + 1:], path)
+
+        self.traced.update(batch)
+        with open(self.cache_path, 'w') as f:
+            json.dump(self.cache, f)
+        with open(self.traced_path, 'w') as f:
+            f.write('\n'.join(sorted(self.traced)) + '\n')
+
+    def write(self, data, parent):
+        digest = hashlib.sha1(data).hexdigest()
+        if digest in self.written:
+            return
+        self.written.add(digest)
+        src = os.path.basename(parent)[3:9]
+        name = f'id:{self.next_id:06d},src:{src},op:concolic'
+        self.next_id += 1
+        # AFL may sync while we write, so the file appears complete
+        tmp = os.path.join(self.dir, '.tmp')
+        with open(tmp, 'wb') as f:
+            f.write(data)
+        os.rename(tmp, os.path.join(self.queue, name))
+        self.stats['written'] += 1
+
+    def run(self):
+        with tempfile.TemporaryDirectory() as tmp:
+            trace_path = os.path.join(tmp, 'trace')
+            while True:
+                pending = self.pending()
+                for i in range(0, len(pending), self.args.batch):
+                    self.run_batch(pending[i:i + self.args.batch], trace_path)
+                    print(' '.join(f'{k} {v}' for k, v in self.stats.items()), flush=True)
+                if not self.args.loop:
+                    break
+                if not pending:
+                    time.sleep(self.args.interval)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('-o', '--output', required=True)
+    parser.add_argument('--name', default='concolic')
+    parser.add_argument('--batch', type=int, default=32)
+    parser.add_argument('--timeout', type=float, default=5)
+    parser.add_argument('--loop', action='store_true')
+    parser.add_argument('--strict', action='store_true',
+                        help='fail when a trace drops a branch on several input bytes')
+    parser.add_argument('--interval', type=float, default=5)
+    parser.add_argument('target', nargs=argparse.REMAINDER)
+    args = parser.parse_args()
+    if args.target[:1] == ['--']:
+        args.target = args.target[1:]
+    if not args.target:
+        parser.error('no target')
+    sys.setrecursionlimit(10000)
+    Generator(args).run()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,320 @@
+// Runtime for the concolic pass.
+//
+// Expressions are nodes in one array, node 0 meaning "concrete". Every node
+// depends on a single input byte, which keeps every path constraint solvable
+// by trying the 256 values of its byte (see concolic.py). Deep expressions
+// are concretized. Values over several input bytes are out of scope: an
+// operation on two different input bytes, or a load that does not read back
+// exactly one store (e.g. an int read from the input bytes), gives the node
+// DROPPED, and a branch on it is only reported as dropped. Shadow memory maps
+// an address to the node stored there, the size of the store and the byte of
+// the store it is, in an open addressing table.
+//
+// Every branch on a symbolic condition appends its constraint to the trace
+// (CONCOLIC_OUT, default concolic.trace), together with the nodes it uses:
+//   n <id> <op> <width> <byte> <a> <b> <concrete a> <concrete b>
+//   c <site> <node> <taken>
+//   d <site>
+// At most MAX_PER_SITE constraints are kept per site, so a loop over the
+// input does not drown the rest of the path. The trace is flushed on exit
+// and on crashing signals, so crashing inputs are traced too.
+//
+// Build this file without instrumentation and link it into the target.
+
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_NODES (1 << 20)
+#define MAX_DEPTH 64
+#define SHADOW_SIZE (1 << 20)
+#define MAX_PROBE 32
+#define MAX_ARGS 16
+#define MAX_SITES 65536
+#define MAX_PER_SITE 64
+#define MAX_CONSTRAINTS 8192
+
+enum { OP_INPUT = 0 };
+
+// Node of the values over several input bytes
+#define DROPPED 1
+
+typedef struct {
+  uint8_t op;
+  uint8_t depth;
+  uint8_t width;
+  uint8_t written;
+  int32_t byte;
+  uint32_t a, b;
+  uint64_t ca, cb;
+} Node;
+
+typedef struct {
+  uintptr_t addr;
+  uint32_t node;
+  uint8_t size;
+  uint8_t part;
+} ShadowEntry;
+
+typedef struct {
+  uint32_t node;
+  uint64_t value;
+} Slot;
+
+static Node nodes[MAX_NODES];
+static uint32_t num_nodes = DROPPED + 1;
+
+static ShadowEntry shadow[SHADOW_SIZE];
+static uint32_t num_shadow;
+
+static Slot args[MAX_ARGS];
+static Slot ret;
+
+static uint16_t site_counts[MAX_SITES];
+static uint32_t num_constraints;
+static FILE *trace;
+
+// Shadow memory
+
+static ShadowEntry *find_shadow(uintptr_t addr, int insert) {
+  uint32_t h = (uint32_t)((addr * 0x9E3779B97F4A7C15ULL) >> 44) & (SHADOW_SIZE - 1);
+  for (int i = 0; i < MAX_PROBE; i++) {
+    ShadowEntry *e = &shadow[(h + i) & (SHADOW_SIZE - 1)];
+    if (e->addr == addr)
+      return e;
+    if (!e->addr) {
+      if (!insert)
+        return NULL;
+      e->addr = addr;
+      num_shadow++;
+      return e;
+    }
+  }
+  return NULL;
+}
+
+static void set_shadow(uintptr_t addr, uint32_t node, uint8_t size, uint8_t part) {
+  ShadowEntry *e = find_shadow(addr, node != 0);
+  if (e) {
+    e->node = node;
+    e->size = size;
+    e->part = part;
+  }
+}
+
+// Expressions
+
+static uint32_t new_node(uint8_t op, uint8_t width, int32_t byte, uint32_t a,
+                         uint64_t ca, uint32_t b, uint64_t cb) {
+  if (num_nodes == MAX_NODES)
+    return 0;
+  uint8_t depth = 1;
+  if (a && nodes[a].depth >= depth)
+    depth = nodes[a].depth + 1;
+  if (b && nodes[b].depth >= depth)
+    depth = nodes[b].depth + 1;
+  if (depth > MAX_DEPTH)
+    return 0;
+
+  Node *n = &nodes[num_nodes];
+  n->op = op;
+  n->depth = depth;
+  n->width = width;
+  n->byte = byte;
+  n->a = a;
+  n->b = b;
+  n->ca = a ? 0 : ca;
+  n->cb = b ? 0 : cb;
+  return num_nodes++;
+}
+
+// argv[CONCOLIC_ARG] (default 1) is the input, one node per byte
+void __concolic_main(int argc, char **argv) {
+  const char *arg = getenv("CONCOLIC_ARG");
+  int index = arg ? atoi(arg) : 1;
+  if (index <= 0 || index >= argc)
+    return;
+
+  char *input = argv[index];
+  size_t len = strlen(input);
+  for (size_t i = 0; i < len; i++) {
+    uint32_t node = new_node(OP_INPUT, 8, (int32_t)i, 0, 0, 0, 0);
+    set_shadow((uintptr_t)&input[i], node, 1, 0);
+  }
+}
+
+uint32_t __concolic_expr(uint32_t op, uint32_t width, uint32_t a, uint64_t ca,
+                         uint32_t b, uint64_t cb) {
+  if (!a && !b)
+    return 0;
+  // Only expressions over a single input byte
+  if (a == DROPPED || b == DROPPED || (a && b && nodes[a].byte != nodes[b].byte))
+    return DROPPED;
+  int32_t byte = a ? nodes[a].byte : nodes[b].byte;
+  return new_node(op, width, byte, a, ca, b, cb);
+}
+
+uint32_t __concolic_load(char *p, uint32_t size) {
+  if (!num_shadow)
+    return 0;
+  ShadowEntry *first = find_shadow((uintptr_t)p, 0);
+  ShadowEntry *last = find_shadow((uintptr_t)p + size - 1, 0);
+  // The whole value must come from the same store
+  if (first && first->node && first->part == 0 && first->size == size && last &&
+      last->node == first->node && last->part == size - 1)
+    return first->node;
+  for (uint32_t i = 0; i < size; i++) {
+    ShadowEntry *e = find_shadow((uintptr_t)p + i, 0);
+    if (e && e->node)
+      return DROPPED;
+  }
+  return 0;
+}
+
+void __concolic_store(char *p, uint32_t size, uint32_t node) {
+  if (!node && !num_shadow)
+    return;
+  for (uint32_t i = 0; i < size; i++)
+    set_shadow((uintptr_t)p + i, node, size, i);
+}
+
+void __concolic_memcpy(char *dst, char *src, uint64_t n) {
+  if (!num_shadow)
+    return;
+  // Go backwards when dst overlaps the end of src, like memmove
+  int backwards = dst > src && dst < src + n;
+  for (uint64_t k = 0; k < n; k++) {
+    uint64_t i = backwards ? n - 1 - k : k;
+    ShadowEntry *e = find_shadow((uintptr_t)src + i, 0);
+    if (e && e->node)
+      set_shadow((uintptr_t)dst + i, e->node, e->size, e->part);
+    else
+      set_shadow((uintptr_t)dst + i, 0, 0, 0);
+  }
+}
+
+void __concolic_clear(char *p, uint64_t n) {
+  if (!num_shadow)
+    return;
+  for (uint64_t i = 0; i < n; i++)
+    set_shadow((uintptr_t)p + i, 0, 0, 0);
+}
+
+// Calls. A slot is taken by the callee only if the concrete value matches,
+// so a call through uninstrumented code does not pick up a stale shadow.
+
+void __concolic_set_arg(uint32_t i, uint32_t node, uint64_t value) {
+  if (i < MAX_ARGS) {
+    args[i].node = node;
+    args[i].value = value;
+  }
+}
+
+uint32_t __concolic_get_arg(uint32_t i, uint64_t value) {
+  if (i >= MAX_ARGS)
+    return 0;
+  uint32_t node = args[i].value == value ? args[i].node : 0;
+  args[i].node = 0;
+  return node;
+}
+
+void __concolic_set_ret(uint32_t node, uint64_t value) {
+  ret.node = node;
+  ret.value = value;
+}
+
+uint32_t __concolic_get_ret(uint64_t value) {
+  uint32_t node = ret.value == value ? ret.node : 0;
+  ret.node = 0;
+  return node;
+}
+
+// Trace
+
+static void flush_trace(void) {
+  if (trace)
+    fflush(trace);
+}
+
+static void crash_handler(int sig) {
+  flush_trace();
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+static int open_trace(void) {
+  if (trace)
+    return 1;
+  const char *path = getenv("CONCOLIC_OUT");
+  trace = fopen(path ? path : "concolic.trace", "w");
+  if (!trace)
+    return 0;
+  atexit(flush_trace);
+  int signals[] = {SIGABRT, SIGSEGV, SIGBUS, SIGFPE, SIGILL};
+  for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++)
+    signal(signals[i], crash_handler);
+  return 1;
+}
+
+// Operands before the node, each node once
+static void write_node(uint32_t id) {
+  Node *n = &nodes[id];
+  if (!id || n->written)
+    return;
+  write_node(n->a);
+  write_node(n->b);
+  fprintf(trace, "n %u %u %u %d %u %u %llu %llu\n", id, n->op, n->width, n->byte,
+          n->a, n->b, (unsigned long long)n->ca, (unsigned long long)n->cb);
+  n->written = 1;
+}
+
+static void add_constraint(uint32_t site, uint32_t node, int taken) {
+  if (!node || num_constraints >= MAX_CONSTRAINTS || !open_trace())
+    return;
+  write_node(node);
+  fprintf(trace, "c %u %u %d\n", site, node, taken);
+  num_constraints++;
+}
+
+static int count_site(uint32_t site) {
+  uint16_t *count = &site_counts[site % MAX_SITES];
+  if (*count >= MAX_PER_SITE)
+    return 0;
+  (*count)++;
+  return 1;
+}
+
+static void add_dropped(uint32_t site) {
+  if (!open_trace())
+    return;
+  fprintf(trace, "d %u\n", site);
+}
+
+void __concolic_branch(uint32_t site, uint32_t node, uint32_t taken) {
+  if (!node || !count_site(site))
+    return;
+  if (node == DROPPED)
+    add_dropped(site);
+  else
+    add_constraint(site, node, taken != 0);
+}
+
+// One "condition == case" constraint per case
+void __concolic_switch(uint32_t site, uint32_t node, uint32_t width, uint64_t value,
+                       const uint64_t *cases, uint32_t n) {
+  if (!node || !count_site(site))
+    return;
+  if (node == DROPPED) {
+    add_dropped(site);
+    return;
+  }
+  uint64_t mask = width >= 64 ? ~0ULL : (1ULL << width) - 1;
+  for (uint32_t i = 0; i < n; i++) {
+    // Eq is 17 in the operator numbering of the pass
+    uint32_t eq = __concolic_expr(17, width, node, 0, 0, cases[i]);
+    add_constraint(site, eq, (value & mask) == (cases[i] & mask));
+  }
+}
@@ -0,0 +1,22 @@
+#!/bin/bash
+# Fuzz an argv-based target with AFL++ and the concolic seed generator side
+# by side. The fuzzer runs through ../Assignment3/ArgvShim, so the test case
+# is argv[1] for both.
+# Usage: ./run.sh <target .c> <input dir>
+name=$(basename "$1" .c)
+source=$(realpath "$1")
+out="$PWD/output_$name"
+clang -O0 -g -emit-llvm -c "$1" -o "$name.bc"
+opt -enable-new-pm=0 -load ~/llvm-project/build/lib/Concolic.so -concolic < "$name.bc" > "$name.concolic.bc"
+
+# The runtime must not be instrumented itself
+clang -O2 -c concolic_rt.c -o concolic_rt.o
+clang -O0 "$name.concolic.bc" concolic_rt.o -o "$name.concolic"
+
+(cd ../Assignment3/ArgvShim && ./build.sh "$name" "$source")
+(cd ../Assignment3/ArgvShim &&
+  AFL_PRELOAD=./argv_shim.so AFL_PERSISTENT=1 AFL_DEFER_FORKSRV=1 \
+  afl-fuzz -M main -i "$(realpath -m "$OLDPWD/$2")" -o "$out" -- "./$name" > /dev/null) &
+trap 'kill %1' EXIT
+
+./concolic.py -o "$out" --loop -- "./$name.concolic"
@@ -0,0 +1,419 @@
+// Extract an AFL dictionary from the constants a fuzz target compares its
+// input against.
+//
+// Starting from the fuzz entry point (-afldict-entry, main by default), the
+// pass walks the direct calls to find the reachable functions and collects:
+//   - constant operands of icmp and switch,
+//   - constant string arguments of strcmp/strncmp/memcmp and friends,
+//   - constant strings and arrays the functions read or copy.
+// If the other side of a compare is an affine function of a value, like
+// passwordBuffer[i] - offsetA + offsetB, the offset is resolved (through
+// the single store of an -O0 local and the constant arguments of all call
+// sites) and subtracted, so the token holds the bytes the input must
+// contain. A constant array compared element by element becomes one token.
+// Tokens are written to -afldict-out for afl-fuzz -x.
+
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cxxabi.h>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace llvm;
+using namespace std;
+
+// Strings for output
+std::string output_str;
+raw_string_ostream output(output_str);
+
+static cl::opt<string> DictEntry("afldict-entry", cl::init("main"),
+                                 cl::desc("Fuzz entry point, tokens are collected from the functions it reaches"));
+
+static cl::opt<string> DictOut("afldict-out", cl::init("afl.dict"),
+                               cl::desc("Write the AFL dictionary here"));
+
+// afl-fuzz rejects longer tokens (MAX_DICT_FILE)
+static const size_t MaxTokenLength = 128;
+
+namespace {
+class Dictionary : public ModulePass {
+public:
+  static char ID;
+
+  Dictionary() : ModulePass(ID) {}
+
+  bool runOnModule(Module &M) override {
+    Function *entry = M.getFunction(DictEntry);
+    if (!entry || entry->isDeclaration()) {
+      errs() << "Entry function " << DictEntry << " not found\n";
+      return false;
+    }
+
+    for (Function *F : reachableFunctions(entry)) {
+      for (Instruction &I : instructions(F)) {
+        if (ICmpInst *icmp = dyn_cast<ICmpInst>(&I)) {
+          checkCompare(icmp, icmp->getOperand(0), icmp->getOperand(1));
+          checkCompare(icmp, icmp->getOperand(1), icmp->getOperand(0));
+        } else if (SwitchInst *switchInst = dyn_cast<SwitchInst>(&I)) {
+          for (auto &c : switchInst->cases()) {
+            checkCompare(switchInst, switchInst->getCondition(), c.getCaseValue());
+          }
+        } else if (CallInst *callInst = dyn_cast<CallInst>(&I)) {
+          checkStringCall(callInst);
+        }
+        checkConstantStrings(&I);
+      }
+    }
+
+    std::error_code EC;
+    raw_fd_ostream dict(DictOut, EC, sys::fs::OF_Text);
+    if (EC) {
+      errs() << "Cannot write " << DictOut << ": " << EC.message() << "\n";
+      return false;
+    }
+    for (auto &token : tokens) {
+      dict << "# " << token.second << "\n";
+      dict << "token_" << tokenIds[token.first] << "=\"" << escape(token.first) << "\"\n";
+    }
+
+    output << DictOut << ": " << tokens.size() << " tokens from " << DictEntry << "\n";
+    errs() << output.str();
+    output.flush();
+
+    cleanGlobalVariables();
+    return false;
+  }
+
+private:
+  // token -> where it was found, in the order found
+  vector<pair<string, string>> tokens;
+  unordered_map<string, unsigned> tokenIds;
+  unordered_set<Value *> resolving;
+
+  // Defined functions reachable from entry through direct calls
+  vector<Function *> reachableFunctions(Function *entry) {
+    vector<Function *> worklist = {entry};
+    unordered_set<Function *> seen = {entry};
+    for (size_t i = 0; i < worklist.size(); i++) {
+      for (Instruction &I : instructions(worklist[i])) {
+        CallBase *call = dyn_cast<CallBase>(&I);
+        Function *callee = call ? call->getCalledFunction() : nullptr;
+        if (callee && !callee->isDeclaration() && seen.insert(callee).second) {
+          worklist.push_back(callee);
+        }
+      }
+    }
+    return worklist;
+  }
+
+  // compared == constant: the token is the constant with the offset of the
+  // affine transform of compared undone
+  void checkCompare(Instruction *I, Value *compared, Value *other) {
+    Value *leaf;
+    int64_t offset;
+    decompose(compared, leaf, offset);
+
+    int64_t value;
+    vector<uint8_t> bytes;
+    if (resolveConstant(other, value)) {
+      // Only integers read from memory other than local variables (like
+      // loop counters), in their width before the casts. Single bytes and
+      // 0, 1, -1 are cheap for havoc to find anyway.
+      LoadInst *loadInst = dyn_cast<LoadInst>(leaf);
+      if (!loadInst || isa<AllocaInst>(loadInst->getPointerOperand()) ||
+          !leaf->getType()->isIntegerTy()) {
+        return;
+      }
+      unsigned width = leaf->getType()->getIntegerBitWidth();
+      if (width < 16 || value == 0 || value == 1 || value == -1) {
+        return;
+      }
+      uint64_t input = value - offset;
+      for (unsigned i = 0; i < width / 8; i++) {
+        bytes.push_back(input >> (8 * i));
+      }
+    } else if (constantElements(other, bytes)) {
+      for (uint8_t &byte : bytes) {
+        byte -= offset;
+      }
+    } else {
+      return;
+    }
+
+    addToken(string(bytes.begin(), bytes.end()), I,
+             offset ? "compare, offset " + to_string(offset) + " undone" : "compare");
+  }
+
+  // Constant string arguments of string and memory compares
+  void checkStringCall(CallInst *callInst) {
+    static const unordered_set<string> names = {
+        "strcmp", "strncmp", "strcasecmp", "strncasecmp", "memcmp", "bcmp",
+        "strstr", "strcasestr", "memmem", "strcspn", "strspn", "strpbrk"};
+    Function *callee = callInst->getCalledFunction();
+    if (!callee || !names.count(callee->getName().str())) {
+      return;
+    }
+
+    for (Value *arg : callInst->args()) {
+      StringRef str;
+      if (getConstantStringInfo(arg, str)) {
+        addToken(str.str(), callInst, callee->getName().str());
+      }
+    }
+  }
+
+  // Constant strings and arrays used by the function, except format strings
+  void checkConstantStrings(Instruction *I) {
+    if (CallInst *callInst = dyn_cast<CallInst>(I)) {
+      Function *callee = callInst->getCalledFunction();
+      if (callee && callee->getName().contains("printf")) {
+        return;
+      }
+    }
+    for (Value *operand : I->operands()) {
+      GlobalVariable *global = dyn_cast<GlobalVariable>(getUnderlyingObject(operand));
+      if (!global || !global->isConstant() || !global->hasDefinitiveInitializer()) {
+        continue;
+      }
+      vector<uint8_t> bytes;
+      if (constantBytes(global->getInitializer(), bytes)) {
+        addToken(string(bytes.begin(), bytes.end()), I, "constant " + global->getName().str());
+      }
+    }
+  }
+
+  // value = leaf + offset, through casts, additions and subtractions of
+  // constants and -O0 locals with a single store
+  void decompose(Value *value, Value *&leaf, int64_t &offset) {
+    offset = 0;
+    leaf = value;
+    unordered_set<Value *> visited;
+    while (visited.insert(leaf).second) {
+      int64_t c;
+      if (CastInst *cast = dyn_cast<CastInst>(leaf)) {
+        if (!cast->isIntegerCast()) {
+          break;
+        }
+        leaf = cast->getOperand(0);
+      } else if (BinaryOperator *binOp = dyn_cast<BinaryOperator>(leaf)) {
+        if (binOp->getOpcode() == Instruction::Add && resolveConstant(binOp->getOperand(1), c)) {
+          offset += c;
+          leaf = binOp->getOperand(0);
+        } else if (binOp->getOpcode() == Instruction::Add && resolveConstant(binOp->getOperand(0), c)) {
+          offset += c;
+          leaf = binOp->getOperand(1);
+        } else if (binOp->getOpcode() == Instruction::Sub && resolveConstant(binOp->getOperand(1), c)) {
+          offset -= c;
+          leaf = binOp->getOperand(0);
+        } else {
+          break;
+        }
+      } else if (Value *stored = getSingleStoredValue(leaf)) {
+        leaf = stored;
+      } else {
+        break;
+      }
+    }
+  }
+
+  // Constant value of an integer, also through -O0 locals with a single
+  // store and arguments that every call site passes the same constant for
+  bool resolveConstant(Value *value, int64_t &result) {
+    if (ConstantInt *constant = dyn_cast<ConstantInt>(value)) {
+      if (constant->getBitWidth() > 64) {
+        return false;
+      }
+      result = constant->getSExtValue();
+      return true;
+    }
+    if (!resolving.insert(value).second) {
+      return false;
+    }
+
+    bool resolved = false;
+    if (CastInst *cast = dyn_cast<CastInst>(value)) {
+      resolved = cast->isIntegerCast() && resolveConstant(cast->getOperand(0), result);
+    } else if (Value *stored = getSingleStoredValue(value)) {
+      resolved = resolveConstant(stored, result);
+    } else if (Argument *arg = dyn_cast<Argument>(value)) {
+      resolved = resolveArgument(arg, result);
+    }
+
+    resolving.erase(value);
+    return resolved;
+  }
+
+  // The fuzz target is one module, so its call sites are all the callers
+  bool resolveArgument(Argument *arg, int64_t &result) {
+    Function *F = arg->getParent();
+    bool found = false;
+    for (User *user : F->users()) {
+      CallBase *call = dyn_cast<CallBase>(user);
+      if (!call || call->getCalledFunction() != F) {
+        return false;
+      }
+      int64_t value;
+      if (!resolveConstant(call->getArgOperand(arg->getArgNo()), value) ||
+          (found && value != result)) {
+        return false;
+      }
+      result = value;
+      found = true;
+    }
+    return found;
+  }
+
+  // For a load from an alloca that is stored exactly once, the stored value
+  Value *getSingleStoredValue(Value *value) {
+    LoadInst *loadInst = dyn_cast<LoadInst>(value);
+    AllocaInst *allocaInst =
+        loadInst ? dyn_cast<AllocaInst>(loadInst->getPointerOperand()) : nullptr;
+    if (!allocaInst) {
+      return nullptr;
+    }
+
+    Value *stored = nullptr;
+    for (User *user : allocaInst->users()) {
+      if (StoreInst *storeInst = dyn_cast<StoreInst>(user)) {
+        if (stored || storeInst->getPointerOperand() != allocaInst) {
+          return nullptr;
+        }
+        stored = storeInst->getValueOperand();
+      } else if (!isa<LoadInst>(user) && !isa<DbgInfoIntrinsic>(user)) {
+        // Address taken, e.g. cin >> x
+        return nullptr;
+      }
+    }
+    return stored;
+  }
+
+  // Elements of the constant array that value is loaded from, either a
+  // constant global or a local initialized by memcpy from one
+  bool constantElements(Value *value, vector<uint8_t> &bytes) {
+    while (CastInst *cast = dyn_cast<CastInst>(value)) {
+      value = cast->getOperand(0);
+    }
+    LoadInst *loadInst = dyn_cast<LoadInst>(value);
+    if (!loadInst) {
+      return false;
+    }
+
+    Value *object = getUnderlyingObject(loadInst->getPointerOperand());
+    if (AllocaInst *allocaInst = dyn_cast<AllocaInst>(object)) {
+      object = getMemcpySource(allocaInst);
+    }
+    GlobalVariable *global = dyn_cast_or_null<GlobalVariable>(object);
+    return global && global->isConstant() && global->hasDefinitiveInitializer() &&
+           constantBytes(global->getInitializer(), bytes);
+  }
+
+  Value *getMemcpySource(AllocaInst *allocaInst) {
+    for (User *user : allocaInst->users()) {
+      // The memcpy may take a bitcast of the alloca
+      SmallVector<User *, 4> candidates = {user};
+      if (isa<BitCastInst>(user)) {
+        candidates.append(user->user_begin(), user->user_end());
+      }
+      for (User *candidate : candidates) {
+        MemCpyInst *memcpy = dyn_cast<MemCpyInst>(candidate);
+        if (memcpy && getUnderlyingObject(memcpy->getRawDest()) == allocaInst) {
+          return getUnderlyingObject(memcpy->getRawSource());
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  // Bytes of an i8 array, without the terminating NUL of a C string
+  bool constantBytes(Constant *init, vector<uint8_t> &bytes) {
+    ConstantDataSequential *data = dyn_cast<ConstantDataSequential>(init);
+    if (!data || !data->getElementType()->isIntegerTy(8)) {
+      return false;
+    }
+    StringRef raw = data->getRawDataValues();
+    if (data->isCString()) {
+      raw = raw.drop_back();
+    }
+    if (raw.size() < 2) {
+      return false;
+    }
+    bytes.assign(raw.begin(), raw.end());
+    return true;
+  }
+
+  void addToken(string token, Instruction *I, const string &how) {
+    if (token.empty()) {
+      return;
+    }
+    if (token.size() > MaxTokenLength) {
+      token.resize(MaxTokenLength);
+    }
+    if (tokenIds.count(token)) {
+      return;
+    }
+    tokenIds[token] = tokens.size();
+
+    string where = demangle(I->getFunction()->getName().str().c_str());
+    if (DILocation *loc = I->getDebugLoc()) {
+      where += " " + loc->getFilename().str() + ":" + to_string(loc->getLine());
+    }
+    tokens.push_back({token, where + ", " + how});
+  }
+
+  // AFL dictionary escaping: printable ASCII as is, the rest as \xNN
+  string escape(const string &token) {
+    string escaped;
+    char hex[5];
+    for (unsigned char c : token) {
+      if (c == '"' || c == '\\') {
+        escaped += '\\';
+        escaped += c;
+      } else if (c >= 32 && c < 127) {
+        escaped += c;
+      } else {
+        snprintf(hex, sizeof(hex), "\\x%02x", c);
+        escaped += hex;
+      }
+    }
+    return escaped;
+  }
+
+  // Reset all global variables when a new module is run.
+  void cleanGlobalVariables() {
+    tokens.clear();
+    tokenIds.clear();
+    resolving.clear();
+    output_str = "";
+  }
+
+  // Demangles the function name.
+  std::string demangle(const char *name) {
+    int status = -1;
+
+    std::unique_ptr<char, void (*)(void *)> res{
+        abi::__cxa_demangle(name, NULL, NULL, &status), std::free};
+    return (status == 0) ? res.get() : std::string(name);
+  }
+
+}; // Dictionary
+} // namespace
+
+char Dictionary::ID = 0;
+static RegisterPass<Dictionary> X("afldict",
+                                  "Pass to extract an AFL dictionary from compared constants");
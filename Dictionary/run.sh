@@ -0,0 +1,14 @@
+#!/bin/bash
+# Extract a dictionary from a fuzz target and fuzz it with the tokens. The
+# target runs through ../Assignment3/ArgvShim, so the test case is argv[1].
+# Usage: ./run.sh <target .c> <input dir> [entry function]
+name=$(basename "$1" .c)
+source=$(realpath "$1")
+inputs=$(realpath "$2")
+clang -O0 -g -S -emit-llvm -fno-discard-value-names -o "$name.ll" -c "$1"
+opt -enable-new-pm=0 -load ~/llvm-project/build/lib/Dictionary.so -afldict -afldict-entry="${3:-main}" -afldict-out="$name.dict" -disable-output "$name.ll"
+
+shim=$(realpath ../Assignment3/ArgvShim)
+(cd "$shim" && ./build.sh "$OLDPWD/$name" -O0 "$source") || exit 1
+AFL_PRELOAD="$shim/argv_shim.so" AFL_PERSISTENT=1 AFL_DEFER_FORKSRV=1 \
+  afl-fuzz -i "$inputs" -o "output_$name" -x "$name.dict" -- "./$name"
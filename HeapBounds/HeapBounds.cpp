@@ -0,0 +1,203 @@
+// Lightweight heap bounds checking for fuzz targets.
+//
+// Calls to malloc/calloc/realloc/free are redirected to the size-class
+// allocator in heapbounds_rt.c, and every load, store and memcpy/memmove/memset
+// through a pointer that may point into the heap gets a __hb_check(base, ptr,
+// size) call, where base is the pointer the address was computed from. No
+// check is emitted when the pass can show the access is safe:
+//   - the address is derived from an alloca or a global (not heap memory),
+//   - the address is a constant offset into a malloc of constant size and the
+//     access fits, or
+//   - the same access was already checked earlier in the block with no call
+//     in between.
+
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cxxabi.h>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace llvm;
+using namespace std;
+
+// Strings for output
+std::string output_str;
+raw_string_ostream output(output_str);
+
+namespace {
+class HeapBounds : public FunctionPass {
+public:
+  static char ID;
+
+  HeapBounds() : FunctionPass(ID) {}
+
+  // Declare the runtime functions, with the same types as the allocation
+  // functions they replace.
+  bool doInitialization(Module &M) override {
+    for (const char *name : {"malloc", "calloc", "realloc", "free"}) {
+      if (Function *F = M.getFunction(name)) {
+        FunctionCallee replacement =
+            M.getOrInsertFunction(string("__hb_") + name, F->getFunctionType());
+        replacements[F] = replacement;
+      }
+    }
+
+    LLVMContext &C = M.getContext();
+    checkFunc = M.getOrInsertFunction("__hb_check", Type::getVoidTy(C),
+                                      Type::getInt8PtrTy(C),
+                                      Type::getInt8PtrTy(C),
+                                      Type::getInt64Ty(C));
+    return true;
+  }
+
+  bool runOnFunction(Function &F) override {
+    if (F.isDeclaration() || F.getName().startswith("__hb_"))
+      return false;
+
+    const DataLayout &DL = F.getParent()->getDataLayout();
+    int checks = 0, provenSafe = 0;
+
+    // Allocation calls are redirected after the checks are placed, so that
+    // isKnownSafe still recognizes malloc.
+    vector<CallInst *> allocCalls;
+
+    for (BasicBlock &b : F) {
+      // Accesses already checked in this block: (base, pointer, size)
+      set<tuple<Value *, Value *, uint64_t>> checked;
+
+      for (auto It = b.begin(); It != b.end();) {
+        Instruction *I = &*It++;
+
+        vector<pair<Value *, Value *>> accesses; // (pointer, size)
+        if (LoadInst *loadInst = dyn_cast<LoadInst>(I)) {
+          accesses.push_back({loadInst->getPointerOperand(),
+                              getSize(DL, loadInst->getType())});
+        } else if (StoreInst *storeInst = dyn_cast<StoreInst>(I)) {
+          accesses.push_back({storeInst->getPointerOperand(),
+                              getSize(DL, storeInst->getValueOperand()->getType())});
+        } else if (MemIntrinsic *memInst = dyn_cast<MemIntrinsic>(I)) {
+          accesses.push_back({memInst->getRawDest(), memInst->getLength()});
+          if (MemTransferInst *transfer = dyn_cast<MemTransferInst>(memInst))
+            accesses.push_back({transfer->getRawSource(), memInst->getLength()});
+        } else if (CallInst *callInst = dyn_cast<CallInst>(I)) {
+          Function *callee = callInst->getCalledFunction();
+          if (callee && replacements.count(callee))
+            allocCalls.push_back(callInst);
+          // A call may free or reallocate anything checked so far.
+          checked.clear();
+          continue;
+        }
+
+        for (auto &access : accesses) {
+          Value *pointer = access.first;
+          Value *size = access.second;
+          Value *base = getUnderlyingObject(pointer, 0);
+
+          if (isa<AllocaInst>(base) || isa<GlobalValue>(base) ||
+              isKnownSafe(DL, pointer, size)) {
+            provenSafe++;
+            continue;
+          }
+
+          ConstantInt *constSize = dyn_cast<ConstantInt>(size);
+          auto key = make_tuple(base, pointer,
+                                constSize ? constSize->getZExtValue() : ~0ULL);
+          if (constSize && !checked.insert(key).second) {
+            provenSafe++;
+            continue;
+          }
+
+          IRBuilder<> builder(I);
+          builder.CreateCall(checkFunc,
+                             {builder.CreatePointerCast(base, builder.getInt8PtrTy()),
+                              builder.CreatePointerCast(pointer, builder.getInt8PtrTy()),
+                              builder.CreateZExtOrTrunc(size, builder.getInt64Ty())});
+          checks++;
+        }
+      }
+    }
+
+    for (CallInst *callInst : allocCalls)
+      callInst->setCalledFunction(replacements[callInst->getCalledFunction()]);
+
+    if (checks || provenSafe || !allocCalls.empty()) {
+      output << demangle(F.getName().str().c_str()) << ": " << checks
+             << " checks, " << provenSafe << " proven safe, "
+             << allocCalls.size() << " allocation calls\n";
+    }
+
+    // Print output
+    errs() << output.str();
+    output.flush();
+
+    cleanGlobalVariables();
+    return checks || !allocCalls.empty();
+  }
+
+private:
+  unordered_map<Function *, FunctionCallee> replacements;
+  FunctionCallee checkFunc;
+
+  Value *getSize(const DataLayout &DL, Type *type) {
+    return ConstantInt::get(Type::getInt64Ty(type->getContext()),
+                            DL.getTypeStoreSize(type).getFixedSize());
+  }
+
+  // The access is at a constant offset into a block from malloc(constant) and
+  // lies completely inside it.
+  bool isKnownSafe(const DataLayout &DL, Value *pointer, Value *size) {
+    ConstantInt *constSize = dyn_cast<ConstantInt>(size);
+    if (!constSize)
+      return false;
+
+    APInt offset(DL.getIndexTypeSizeInBits(pointer->getType()), 0);
+    Value *base = pointer->stripAndAccumulateConstantOffsets(DL, offset, true);
+    CallInst *callInst = dyn_cast<CallInst>(base);
+    if (!callInst || !callInst->getCalledFunction() ||
+        callInst->getCalledFunction()->getName() != "malloc")
+      return false;
+
+    ConstantInt *allocSize = dyn_cast<ConstantInt>(callInst->getArgOperand(0));
+    if (!allocSize)
+      return false;
+
+    int64_t begin = offset.getSExtValue();
+    return begin >= 0 &&
+           (uint64_t)begin + constSize->getZExtValue() <= allocSize->getZExtValue();
+  }
+
+  // Reset all global variables when a new function is called.
+  void cleanGlobalVariables() {
+    output_str = "";
+  }
+
+  // Demangles the function name.
+  std::string demangle(const char *name) {
+    int status = -1;
+
+    std::unique_ptr<char, void (*)(void *)> res{
+        abi::__cxa_demangle(name, NULL, NULL, &status), std::free};
+    return (status == 0) ? res.get() : std::string(name);
+  }
+
+}; // HeapBounds
+} // namespace
+
+char HeapBounds::ID = 0;
+static RegisterPass<HeapBounds> X("heapbounds",
+                                  "Pass to check heap accesses against block bounds");
@@ -0,0 +1,183 @@
+// Runtime for the heapbounds pass.
+//
+// Instrumented code allocates through __hb_malloc and friends, which serve
+// every request up to 2 GB from a size-class region: class c holds slots of
+// 16 << c bytes in its own 4 GB span, so the slot of any heap pointer follows
+// from its address alone. A shadow table per class keeps the requested size
+// of each slot, which __hb_check compares every access against. Pointers
+// outside the region (stack, globals, huge blocks from libc) pass unchecked.
+//
+// Build this file without fuzzer instrumentation and link it into the target.
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define MIN_SHIFT 4
+#define NUM_CLASSES 28
+#define CLASS_SHIFT 32
+#define CLASS_SPAN (1ULL << CLASS_SHIFT)
+#define REGION_SIZE (NUM_CLASSES * CLASS_SPAN)
+
+static char *region;
+// Requested size + 1 of every slot, 0 while the slot is free.
+static uint32_t *sizes[NUM_CLASSES];
+static char *bump[NUM_CLASSES];
+static void *free_list[NUM_CLASSES];
+static volatile char lock;
+
+static void hb_lock(void) {
+  while (__atomic_test_and_set(&lock, __ATOMIC_ACQUIRE))
+    ;
+}
+
+static void hb_unlock(void) { __atomic_clear(&lock, __ATOMIC_RELEASE); }
+
+static void *reserve(size_t size) {
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "heapbounds: cannot reserve %zu bytes\n", size);
+    abort();
+  }
+  return p;
+}
+
+static void hb_init(void) {
+  region = reserve(REGION_SIZE);
+  for (int c = 0; c < NUM_CLASSES; c++) {
+    sizes[c] = reserve((CLASS_SPAN >> (c + MIN_SHIFT)) * sizeof(uint32_t));
+    bump[c] = region + c * CLASS_SPAN;
+  }
+}
+
+static int size_class(size_t size) {
+  int c = 0;
+  while (((size_t)1 << (c + MIN_SHIFT)) < size)
+    c++;
+  return c;
+}
+
+static int in_region(const void *p) {
+  return region && (uintptr_t)p - (uintptr_t)region < REGION_SIZE;
+}
+
+static int class_of(const void *p) {
+  return ((uintptr_t)p - (uintptr_t)region) >> CLASS_SHIFT;
+}
+
+static uint64_t slot_of(const void *p, int c) {
+  return (((uintptr_t)p - (uintptr_t)region) & (CLASS_SPAN - 1)) >>
+         (c + MIN_SHIFT);
+}
+
+static char *slot_start(int c, uint64_t slot) {
+  return region + c * CLASS_SPAN + (slot << (c + MIN_SHIFT));
+}
+
+static void report(const char *what, const void *p, size_t n, const char *start,
+                   uint32_t size) {
+  if (size)
+    fprintf(stderr,
+            "heapbounds: %s of %zu bytes at offset %td of a %u-byte block\n",
+            what, n, (const char *)p - start, size - 1);
+  else
+    fprintf(stderr, "heapbounds: %s of %zu bytes at %p in a freed block\n",
+            what, n, p);
+  abort();
+}
+
+void __hb_check(const char *base, const char *p, uint64_t n) {
+  if (!in_region(base))
+    return;
+
+  int c = class_of(base);
+  uint64_t slot = slot_of(base, c);
+  char *start = slot_start(c, slot);
+
+  // A base one past the end of a block lands on the next slot.
+  if (p < start && base == start && slot) {
+    slot--;
+    start = slot_start(c, slot);
+  }
+
+  uint32_t size = sizes[c][slot];
+  if (!size || p < start || p + n > start + size - 1)
+    report("out-of-bounds access", p, n, start, size);
+}
+
+void *__hb_malloc(size_t size) {
+  int c = size_class(size);
+  if (c >= NUM_CLASSES)
+    return malloc(size);
+
+  hb_lock();
+  if (!region)
+    hb_init();
+
+  char *p = free_list[c];
+  if (p) {
+    free_list[c] = *(void **)p;
+  } else {
+    if (bump[c] + ((size_t)1 << (c + MIN_SHIFT)) > region + (c + 1) * CLASS_SPAN) {
+      hb_unlock();
+      return malloc(size);
+    }
+    p = bump[c];
+    bump[c] += (size_t)1 << (c + MIN_SHIFT);
+  }
+  sizes[c][slot_of(p, c)] = size + 1;
+  hb_unlock();
+  return p;
+}
+
+void __hb_free(void *p) {
+  if (!in_region(p)) {
+    free(p);
+    return;
+  }
+
+  int c = class_of(p);
+  uint64_t slot = slot_of(p, c);
+  char *start = slot_start(c, slot);
+
+  hb_lock();
+  if ((char *)p != start || !sizes[c][slot]) {
+    hb_unlock();
+    fprintf(stderr, "heapbounds: %s of %p\n",
+            (char *)p != start ? "invalid free" : "double free", p);
+    abort();
+  }
+  sizes[c][slot] = 0;
+  *(void **)p = free_list[c];
+  free_list[c] = p;
+  hb_unlock();
+}
+
+void *__hb_calloc(size_t n, size_t size) {
+  if (size && n > SIZE_MAX / size)
+    return NULL;
+  void *p = __hb_malloc(n * size);
+  if (p)
+    memset(p, 0, n * size);
+  return p;
+}
+
+void *__hb_realloc(void *old, size_t size) {
+  if (!old)
+    return __hb_malloc(size);
+  if (!in_region(old))
+    return realloc(old, size);
+
+  int c = class_of(old);
+  uint32_t old_size = sizes[c][slot_of(old, c)];
+  void *p = __hb_malloc(size);
+  if (p) {
+    memcpy(p, old, old_size && old_size - 1 < size ? old_size - 1 : size);
+    __hb_free(old);
+  }
+  return p;
+}
@@ -0,0 +1,9 @@
+#!/bin/bash
+# Build a fuzz target with heap bounds checks.
+# Usage: ./run.sh <target .c> <output binary>
+clang -O0 -g -emit-llvm -c "$1" -o "$2.bc"
+opt -enable-new-pm=0 -load ~/llvm-project/build/lib/HeapBounds.so -heapbounds < "$2.bc" > "$2.hb.bc"
+
+# The runtime must not be instrumented by the fuzzer
+clang -O2 -c heapbounds_rt.c -o heapbounds_rt.o
+afl-clang-fast -O2 "$2.hb.bc" heapbounds_rt.o -o "$2"
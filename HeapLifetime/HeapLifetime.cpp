@@ -0,0 +1,369 @@
+// Static heap lifetime checker: double free, use after free and leaks.
+//
+// Every malloc call site is an abstract heap object with an allocation state
+// (allocated, freed, maybe freed). The analysis tracks, per program point,
+// which sites each pointer variable (alloca) and each pointer value may point
+// to, and the state of every site. Basic blocks are visited in topological
+// order with the entry/exit set machinery of Assignment1, repeated until the
+// exit sets stop changing so loops are handled, and a last walk reports:
+//   - free of a freed (maybe freed) site: double free (possible double free)
+//   - load/store/memcpy through a freed site: use after free
+//   - a site still allocated at a return and never escaping the function
+//     (returned, stored outside a local variable or passed to an unknown
+//     call): leak (possible leak if it is only maybe freed)
+
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cxxabi.h>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace llvm;
+using namespace std;
+
+// Strings for output
+std::string output_str;
+raw_string_ostream output(output_str);
+
+namespace {
+
+enum AllocState { Allocated, Freed, MaybeFreed };
+
+// Abstract state at one program point.
+struct HeapState {
+  // Sites whose address a local pointer variable holds
+  unordered_map<Value *, set<CallInst *>> varPointsTo;
+  // Sites a pointer value points into
+  unordered_map<Value *, set<CallInst *>> valuePointsTo;
+  unordered_map<CallInst *, AllocState> sites;
+
+  bool operator==(const HeapState &other) const {
+    return varPointsTo == other.varPointsTo &&
+           valuePointsTo == other.valuePointsTo && sites == other.sites;
+  }
+  bool operator!=(const HeapState &other) const { return !(*this == other); }
+
+  // Union of the points-to sets, allocated + freed = maybe freed.
+  void join(const HeapState &other) {
+    for (auto &entry : other.varPointsTo)
+      varPointsTo[entry.first].insert(entry.second.begin(), entry.second.end());
+    for (auto &entry : other.valuePointsTo)
+      valuePointsTo[entry.first].insert(entry.second.begin(), entry.second.end());
+    for (auto &entry : other.sites) {
+      auto it = sites.find(entry.first);
+      if (it == sites.end())
+        sites[entry.first] = entry.second;
+      else if (it->second != entry.second)
+        it->second = MaybeFreed;
+    }
+  }
+};
+
+class HeapLifetime : public FunctionPass {
+public:
+  static char ID;
+
+  HeapLifetime() : FunctionPass(ID) {}
+
+  bool runOnFunction(Function &F) override {
+    std::string funcName = demangle(F.getName().str().c_str());
+    if (F.isDeclaration())
+      return false;
+
+    vector<BasicBlock *> blocks = topoSortBBs(F);
+
+    // Iterate until all exitSets don't change
+    bool change = true;
+    while (change) {
+      change = false;
+      for (auto b : blocks) {
+        HeapState state = getEntryState(b);
+        for (Instruction &I : *b)
+          transfer(&I, state, false);
+        if (state != exitSetMap[b]) {
+          change = true;
+          exitSetMap[b] = state;
+        }
+      }
+    }
+
+    // Report on the fixpoint
+    for (auto b : blocks) {
+      HeapState state = getEntryState(b);
+      for (Instruction &I : *b)
+        transfer(&I, state, true);
+    }
+
+    for (auto &bug : bugs)
+      output << funcName << " : " << bug.first << " : " << bug.second << "\n";
+
+    // Print output
+    errs() << output.str();
+    output.flush();
+
+    cleanGlobalVariables();
+    return false;
+  }
+
+private:
+  unordered_map<BasicBlock *, HeapState> exitSetMap;
+  // Sites that escape the function somewhere; flow insensitive
+  unordered_set<CallInst *> escaped;
+  // Line -> message, sorted by line
+  multimap<int, string> bugs;
+  set<pair<int, string>> reported;
+
+  // EntrySet of a basic block is the union of all exitSets of the predecessors
+  HeapState getEntryState(BasicBlock *b) {
+    HeapState state;
+    for (BasicBlock *pred : predecessors(b))
+      state.join(exitSetMap[pred]);
+    return state;
+  }
+
+  bool isAllocation(Function *callee) {
+    StringRef name = callee->getName();
+    return name == "malloc" || name == "calloc" || name == "realloc" ||
+           name == "strdup" || name == "_Znwm" || name == "_Znam";
+  }
+
+  bool isDeallocation(Function *callee) {
+    StringRef name = callee->getName();
+    return name == "free" || name == "_ZdlPv" || name == "_ZdaPv" ||
+           name == "_ZdlPvm" || name == "_ZdaPvm";
+  }
+
+  // Library calls that neither free nor keep their pointer arguments.
+  bool isNonCapturing(Function *callee) {
+    static const unordered_set<string> names = {
+        "strlen", "strcmp", "strncmp", "memcmp",  "strcpy", "strncpy",
+        "strcat", "printf", "fprintf", "sprintf", "snprintf", "puts"};
+    return callee->isIntrinsic() || names.count(callee->getName().str());
+  }
+
+  // Sites a value points into, none for values that were never recorded
+  const set<CallInst *> &pointsTo(HeapState &state, Value *value) {
+    static const set<CallInst *> none;
+    auto it = state.valuePointsTo.find(value);
+    return it == state.valuePointsTo.end() ? none : it->second;
+  }
+
+  // Only pointers that point somewhere are kept, so integer loads and
+  // arithmetic do not add entries to the state.
+  void setPointsTo(unordered_map<Value *, set<CallInst *>> &pointsToMap,
+                   Value *key, set<CallInst *> sites) {
+    if (sites.empty())
+      pointsToMap.erase(key);
+    else
+      pointsToMap[key] = move(sites);
+  }
+
+  void setValuePointsTo(HeapState &state, Value *value, set<CallInst *> sites) {
+    if (value->getType()->isPointerTy())
+      setPointsTo(state.valuePointsTo, value, move(sites));
+  }
+
+  void report(Instruction *I, CallInst *site, const string &what) {
+    int line = getSourceCodeLine(I);
+    string message = what + " of memory allocated at line " +
+                     to_string(getSourceCodeLine(site));
+    if (reported.insert({line, message}).second)
+      bugs.insert({line, message});
+  }
+
+  // An access through a pointer into freed memory.
+  void checkAccess(Instruction *I, Value *pointer, HeapState &state, bool doReport) {
+    if (!doReport)
+      return;
+    for (CallInst *site : pointsTo(state, pointer)) {
+      AllocState allocState = state.sites[site];
+      if (allocState == Freed)
+        report(I, site, "use after free");
+      else if (allocState == MaybeFreed)
+        report(I, site, "possible use after free");
+    }
+  }
+
+  void escape(HeapState &state, Value *value) {
+    for (CallInst *site : pointsTo(state, value))
+      escaped.insert(site);
+  }
+
+  void transfer(Instruction *I, HeapState &state, bool doReport) {
+    // Load Instruction
+    if (LoadInst *loadInst = dyn_cast<LoadInst>(I)) {
+      Value *pointer = loadInst->getPointerOperand();
+      if (isa<AllocaInst>(pointer)) {
+        // Reading a local pointer variable
+        auto it = state.varPointsTo.find(pointer);
+        if (it != state.varPointsTo.end())
+          setValuePointsTo(state, loadInst, it->second);
+      } else {
+        checkAccess(I, pointer, state, doReport);
+      }
+    }
+
+    // Store Instruction
+    else if (StoreInst *storeInst = dyn_cast<StoreInst>(I)) {
+      Value *value = storeInst->getValueOperand();
+      Value *pointer = storeInst->getPointerOperand();
+      if (isa<AllocaInst>(pointer)) {
+        // Assigning a local pointer variable, e.g. temp4 = 0
+        if (value->getType()->isPointerTy())
+          setPointsTo(state.varPointsTo, pointer, pointsTo(state, value));
+      } else {
+        checkAccess(I, pointer, state, doReport);
+        escape(state, value);
+      }
+    }
+
+    // Pointer arithmetic and casts keep pointing into the same object
+    else if (isa<GetElementPtrInst>(I) || isa<CastInst>(I)) {
+      setValuePointsTo(state, I, pointsTo(state, I->getOperand(0)));
+    } else if (PHINode *phi = dyn_cast<PHINode>(I)) {
+      set<CallInst *> sites;
+      for (Value *incoming : phi->incoming_values()) {
+        const set<CallInst *> &incomingSites = pointsTo(state, incoming);
+        sites.insert(incomingSites.begin(), incomingSites.end());
+      }
+      setValuePointsTo(state, I, move(sites));
+    } else if (SelectInst *select = dyn_cast<SelectInst>(I)) {
+      set<CallInst *> sites = pointsTo(state, select->getTrueValue());
+      const set<CallInst *> &falseSites = pointsTo(state, select->getFalseValue());
+      sites.insert(falseSites.begin(), falseSites.end());
+      setValuePointsTo(state, I, move(sites));
+    }
+
+    // Memory intrinsics access their pointer arguments
+    else if (MemIntrinsic *memInst = dyn_cast<MemIntrinsic>(I)) {
+      checkAccess(I, memInst->getRawDest(), state, doReport);
+      if (MemTransferInst *transfer = dyn_cast<MemTransferInst>(memInst))
+        checkAccess(I, transfer->getRawSource(), state, doReport);
+    }
+
+    // Call Instruction
+    else if (CallInst *callInst = dyn_cast<CallInst>(I)) {
+      Function *callee = callInst->getCalledFunction();
+
+      if (callee && isDeallocation(callee)) {
+        freeSites(I, callInst->getArgOperand(0), state, doReport);
+      } else if (callee && isAllocation(callee)) {
+        // realloc frees its argument
+        if (callee->getName() == "realloc")
+          freeSites(I, callInst->getArgOperand(0), state, doReport);
+        setValuePointsTo(state, callInst, {callInst});
+        state.sites[callInst] = Allocated;
+      } else {
+        for (Value *arg : callInst->args()) {
+          if (callee && isNonCapturing(callee))
+            checkAccess(I, arg, state, doReport);
+          else
+            escape(state, arg);
+        }
+      }
+    }
+
+    // Return Instruction
+    else if (ReturnInst *retInst = dyn_cast<ReturnInst>(I)) {
+      if (Value *value = retInst->getReturnValue())
+        escape(state, value);
+      if (doReport) {
+        for (auto &entry : state.sites) {
+          if (escaped.count(entry.first))
+            continue;
+          if (entry.second == Allocated)
+            report(I, entry.first, "leak");
+          else if (entry.second == MaybeFreed)
+            report(I, entry.first, "possible leak");
+        }
+      }
+    }
+  }
+
+  void freeSites(Instruction *I, Value *pointer, HeapState &state, bool doReport) {
+    set<CallInst *> sites = pointsTo(state, pointer);
+    for (CallInst *site : sites) {
+      AllocState allocState = state.sites[site];
+      if (doReport && allocState == Freed)
+        report(I, site, "double free");
+      else if (doReport && allocState == MaybeFreed)
+        report(I, site, "possible double free");
+
+      // Only a pointer to a single site is definitely freed
+      state.sites[site] = sites.size() == 1 ? Freed
+                          : allocState == Freed ? Freed : MaybeFreed;
+    }
+  }
+
+  // Reset all global variables when a new function is called.
+  void cleanGlobalVariables() {
+    exitSetMap.clear();
+    escaped.clear();
+    bugs.clear();
+    reported.clear();
+    output_str = "";
+  }
+
+  // Demangles the function name.
+  std::string demangle(const char *name) {
+    int status = -1;
+
+    std::unique_ptr<char, void (*)(void *)> res{
+        abi::__cxa_demangle(name, NULL, NULL, &status), std::free};
+    return (status == 0) ? res.get() : std::string(name);
+  }
+
+  // Returns the source code line number cooresponding to the LLVM instruction.
+  // Returns -1 if the instruction has no associated Metadata.
+  int getSourceCodeLine(Instruction *I) {
+    // Get debugInfo associated with every instruction.
+    llvm::DebugLoc debugInfo = I->getDebugLoc();
+
+    int line = -1;
+    if (debugInfo)
+      line = debugInfo.getLine();
+
+    return line;
+  }
+
+  // Topologically sort all the basic blocks in a function.
+  // Handle cycles in the directed graph using Tarjan's algorithm
+  // of Strongly Connected Components (SCCs).
+  vector<BasicBlock *> topoSortBBs(Function &F) {
+    vector<BasicBlock *> tempBB;
+    for (scc_iterator<Function *> I = scc_begin(&F), IE = scc_end(&F); I != IE;
+        ++I) {
+
+      // Obtain the vector of BBs in this SCC and print it out.
+      const std::vector<BasicBlock *> &SCCBBs = *I;
+
+      for (std::vector<BasicBlock *>::const_iterator BBI = SCCBBs.begin(),
+                                                    BBIE = SCCBBs.end();
+          BBI != BBIE; ++BBI) {
+
+        BasicBlock *b = const_cast<llvm::BasicBlock *>(*BBI);
+        tempBB.push_back(b);
+      }
+    }
+
+    reverse(tempBB.begin(), tempBB.end());
+    return tempBB;
+  }
+
+}; // HeapLifetime
+} // namespace
+
+char HeapLifetime::ID = 0;
+static RegisterPass<HeapLifetime> X("heaplifetime",
+                                    "Pass to find double free, use after free and leaks");
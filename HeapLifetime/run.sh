@@ -0,0 +1,6 @@
+#!/bin/bash
+# Report double frees, uses after free and leaks in a C file.
+# Usage: ./run.sh <file .c>
+name=$(basename "$1" .c)
+clang -O0 -g -S -emit-llvm -o "$name.ll" -c "$1"
+opt -enable-new-pm=0 -load ~/llvm-project/build/lib/HeapLifetime.so -heaplifetime < "$name.ll" > /dev/null
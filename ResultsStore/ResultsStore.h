@@ -0,0 +1,418 @@
+// Binary store of analysis results, written by the passes (-taint-results,
+// -undeclvar-results) and read in place by results_query.
+//
+// A store file is a sequence of segments. Every opt run appends one segment
+// with a single write under an exclusive flock, so parallel runs never
+// interleave and never rewrite what is already in the file. A segment is laid
+// out to be used directly after mmap:
+//   SegmentHeader
+//   uint32_t stringOffsets[numStrings]  offsets into strings, sorted by name
+//   char     strings[]                  NUL terminated names
+//   Record   records[numRecords]
+//   uint32_t byFunction[numRecords]     record ids sorted by function, line
+//   uint32_t byFile[numRecords]         record ids sorted by file, line
+//   uint32_t byVariable[numRecords]     record ids sorted by variable, function
+// Names are interned per segment in sorted order, so comparing string ids is
+// comparing names: a lookup is a binary search for the name, then one for the
+// range of the index. "results_query <store> compact" merges the segments.
+//
+// Every function a run analyzes gets an Analyzed record, even without
+// results. Re-analyzing a file appends a new segment, and its Analyzed
+// records supersede the records of the same function, file and analysis in
+// older segments (Reader::superseded), so stale results are never reported.
+
+#ifndef RESULTS_STORE_H
+#define RESULTS_STORE_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace results {
+
+const uint64_t SEGMENT_MAGIC = 0x3153455253544c52ULL; // "RLTSRES1"
+
+enum RecordKind : uint32_t {
+  Tainted,      // variable is tainted at the exit of the function
+  TaintSink,    // input dependent site, variable is branch/load/store/memory
+  TaintedCall,  // tainted argument passed to a call, variable is the callee
+  UndefinedUse, // use before definition reported by -undeclvar
+  Analyzed,     // function analyzed by this run, variable is the analysis
+  NumKinds
+};
+
+inline const char *kindName(uint32_t kind) {
+  static const char *names[NumKinds] = {"tainted", "sink", "call", "undef", "analyzed"};
+  return kind < NumKinds ? names[kind] : "?";
+}
+
+// Analysis that produces records of a kind, "taint" or "undef"
+inline const char *analysisOf(uint32_t kind) {
+  return kind == UndefinedUse ? "undef" : "taint";
+}
+
+struct SegmentHeader {
+  uint64_t magic;
+  uint32_t size; // whole segment, multiple of 8
+  uint32_t numStrings;
+  uint32_t numRecords;
+  uint32_t stringsOffset;
+  uint32_t recordsOffset;
+  uint32_t byFunctionOffset;
+  uint32_t byFileOffset;
+  uint32_t byVariableOffset;
+};
+
+struct Record {
+  uint32_t kind;
+  uint32_t function;
+  uint32_t file;
+  uint32_t variable;
+  uint32_t line;
+};
+
+// Collects the results of one run and appends them as a segment.
+class Writer {
+public:
+  void add(RecordKind kind, const std::string &function, const std::string &file,
+           unsigned line, const std::string &variable) {
+    entries.push_back({kind, function, file, line, variable});
+  }
+
+  // Mark function as analyzed, so this segment supersedes its older results
+  void analyzed(const std::string &function, const std::string &file, unsigned line,
+                RecordKind kind) {
+    add(Analyzed, function, file, line, analysisOf(kind));
+  }
+
+  bool empty() const { return entries.empty(); }
+
+  // Append one segment to path, creating the store if needed.
+  bool append(const std::string &path, std::string &error) const {
+    std::vector<char> segment = serialize();
+
+    // Retry if results_query compact replaced the file while we waited
+    int fd;
+    while (true) {
+      fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+      if (fd < 0) {
+        error = strerror(errno);
+        return false;
+      }
+      struct stat opened, current;
+      if (flock(fd, LOCK_EX) == 0 && fstat(fd, &opened) == 0 &&
+          stat(path.c_str(), &current) == 0 && opened.st_ino == current.st_ino) {
+        break;
+      }
+      close(fd);
+    }
+
+    size_t done = 0;
+    while (done < segment.size()) {
+      ssize_t n = write(fd, segment.data() + done, segment.size() - done);
+      if (n < 0) {
+        error = strerror(errno);
+        close(fd);
+        return false;
+      }
+      done += n;
+    }
+    close(fd);
+    return true;
+  }
+
+private:
+  struct Entry {
+    RecordKind kind;
+    std::string function, file;
+    unsigned line;
+    std::string variable;
+  };
+  std::vector<Entry> entries;
+
+  std::vector<char> serialize() const {
+    // Intern the names, ids in sorted order
+    std::map<std::string, uint32_t> ids;
+    for (const Entry &e : entries) {
+      ids[e.function];
+      ids[e.file];
+      ids[e.variable];
+    }
+    uint32_t id = 0;
+    for (auto &name : ids) {
+      name.second = id++;
+    }
+
+    std::vector<Record> records;
+    for (const Entry &e : entries) {
+      records.push_back({e.kind, ids[e.function], ids[e.file], ids[e.variable], e.line});
+    }
+    std::sort(records.begin(), records.end(), [](const Record &a, const Record &b) {
+      return std::tie(a.function, a.file, a.line, a.kind, a.variable) <
+             std::tie(b.function, b.file, b.line, b.kind, b.variable);
+    });
+    records.erase(std::unique(records.begin(), records.end(),
+                              [](const Record &a, const Record &b) {
+                                return !memcmp(&a, &b, sizeof(Record));
+                              }),
+                  records.end());
+
+    SegmentHeader header = {};
+    header.magic = SEGMENT_MAGIC;
+    header.numStrings = ids.size();
+    header.numRecords = records.size();
+
+    std::vector<char> out(sizeof(SegmentHeader));
+    std::vector<uint32_t> offsets;
+    std::string strings;
+    for (auto &name : ids) {
+      offsets.push_back(strings.size());
+      strings.append(name.first.c_str(), name.first.size() + 1);
+    }
+    appendArray(out, offsets);
+    header.stringsOffset = out.size();
+    out.insert(out.end(), strings.begin(), strings.end());
+    pad(out);
+
+    header.recordsOffset = out.size();
+    appendArray(out, records);
+    header.byFunctionOffset = out.size();
+    appendArray(out, sortedIndex(records, [](const Record &r) {
+      return std::make_tuple(r.function, r.line, r.file);
+    }));
+    header.byFileOffset = out.size();
+    appendArray(out, sortedIndex(records, [](const Record &r) {
+      return std::make_tuple(r.file, r.line, r.function);
+    }));
+    header.byVariableOffset = out.size();
+    appendArray(out, sortedIndex(records, [](const Record &r) {
+      return std::make_tuple(r.variable, r.function, r.line);
+    }));
+    pad(out);
+
+    header.size = out.size();
+    memcpy(out.data(), &header, sizeof(header));
+    return out;
+  }
+
+  template <typename T>
+  static void appendArray(std::vector<char> &out, const std::vector<T> &array) {
+    const char *data = reinterpret_cast<const char *>(array.data());
+    out.insert(out.end(), data, data + array.size() * sizeof(T));
+  }
+
+  static void pad(std::vector<char> &out) {
+    out.resize((out.size() + 7) & ~size_t(7));
+  }
+
+  template <typename Key>
+  static std::vector<uint32_t> sortedIndex(const std::vector<Record> &records, Key key) {
+    std::vector<uint32_t> index(records.size());
+    for (uint32_t i = 0; i < index.size(); i++) {
+      index[i] = i;
+    }
+    std::stable_sort(index.begin(), index.end(), [&](uint32_t a, uint32_t b) {
+      return key(records[a]) < key(records[b]);
+    });
+    return index;
+  }
+};
+
+// One segment of a mapped store; all pointers point into the mapping.
+struct Segment {
+  const SegmentHeader *header;
+  const uint32_t *stringOffsets;
+  const char *strings;
+  const Record *records;
+  const uint32_t *byFunction;
+  const uint32_t *byFile;
+  const uint32_t *byVariable;
+
+  const char *string(uint32_t id) const { return strings + stringOffsets[id]; }
+
+  // Id of name, or -1 if this segment does not contain it
+  int64_t find(const char *name) const {
+    uint32_t lo = 0, hi = header->numStrings;
+    while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      int cmp = strcmp(string(mid), name);
+      if (cmp == 0) {
+        return mid;
+      }
+      if (cmp < 0) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return -1;
+  }
+
+  // Whether this segment has an Analyzed record of function in file
+  bool analyzed(const char *analysis, const char *function, const char *file) const {
+    int64_t functionId = find(function), fileId = find(file), analysisId = find(analysis);
+    if (functionId < 0 || fileId < 0 || analysisId < 0) {
+      return false;
+    }
+    auto found = range(byFunction, &Record::function, functionId);
+    for (const uint32_t *r = found.first; r != found.second; ++r) {
+      if (records[*r].kind == Analyzed && records[*r].file == fileId &&
+          records[*r].variable == analysisId) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Range of index whose records have field == id
+  std::pair<const uint32_t *, const uint32_t *>
+  range(const uint32_t *index, uint32_t Record::*field, uint32_t id) const {
+    const uint32_t *end = index + header->numRecords;
+    const uint32_t *first = std::lower_bound(
+        index, end, id, [&](uint32_t r, uint32_t v) { return records[r].*field < v; });
+    const uint32_t *last = std::upper_bound(
+        first, end, id, [&](uint32_t v, uint32_t r) { return v < records[r].*field; });
+    return {first, last};
+  }
+};
+
+// Read only mapping of a whole store.
+class Reader {
+public:
+  ~Reader() {
+    if (base) {
+      munmap(base, size);
+    }
+  }
+
+  bool open(const std::string &path, std::string &error) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      error = strerror(errno);
+      return false;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb)) {
+      error = strerror(errno);
+      close(fd);
+      return false;
+    }
+    size = sb.st_size;
+    if (size) {
+      base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+      if (base == MAP_FAILED) {
+        base = nullptr;
+        error = strerror(errno);
+        close(fd);
+        return false;
+      }
+    }
+    close(fd);
+
+    // A segment cut short by a crashed writer ends the store
+    const char *data = static_cast<const char *>(base);
+    size_t offset = 0;
+    while (offset + sizeof(SegmentHeader) <= size) {
+      const SegmentHeader *header = reinterpret_cast<const SegmentHeader *>(data + offset);
+      if (!valid(data + offset, size - offset)) {
+        break;
+      }
+      const char *s = data + offset;
+      segments.push_back({header,
+                          reinterpret_cast<const uint32_t *>(s + sizeof(SegmentHeader)),
+                          s + header->stringsOffset,
+                          reinterpret_cast<const Record *>(s + header->recordsOffset),
+                          reinterpret_cast<const uint32_t *>(s + header->byFunctionOffset),
+                          reinterpret_cast<const uint32_t *>(s + header->byFileOffset),
+                          reinterpret_cast<const uint32_t *>(s + header->byVariableOffset)});
+      offset += header->size;
+    }
+    return true;
+  }
+
+  // Whether a newer segment analyzed the function of a record again. The
+  // file of a record is the file of its function: the passes run on -O0
+  // code, where the sites of a function are in the file it is defined in.
+  // One lookup in the function index of every newer segment.
+  bool superseded(size_t segment, const Record &r) const {
+    const Segment &s = segments[segment];
+    const char *analysis = r.kind == Analyzed ? s.string(r.variable) : analysisOf(r.kind);
+    for (size_t i = segment + 1; i < segments.size(); i++) {
+      if (segments[i].analyzed(analysis, s.string(r.function), s.string(r.file))) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::vector<Segment> segments;
+
+private:
+  // Whether a segment fits in the available bytes, its arrays fit in it and
+  // every string offset, string id and index entry points inside it
+  static bool valid(const char *s, size_t available) {
+    const SegmentHeader *header = reinterpret_cast<const SegmentHeader *>(s);
+    if (header->magic != SEGMENT_MAGIC || header->size < sizeof(SegmentHeader) ||
+        header->size > available || header->size % 8) {
+      return false;
+    }
+    uint64_t size = header->size, records = header->numRecords;
+    if (!(sizeof(SegmentHeader) + uint64_t(header->numStrings) * 4 <= header->stringsOffset &&
+          header->stringsOffset <= header->recordsOffset &&
+          header->recordsOffset % 4 == 0 && header->byFunctionOffset % 4 == 0 &&
+          header->byFileOffset % 4 == 0 && header->byVariableOffset % 4 == 0 &&
+          header->recordsOffset + records * sizeof(Record) <= header->byFunctionOffset &&
+          header->byFunctionOffset + records * 4 <= header->byFileOffset &&
+          header->byFileOffset + records * 4 <= header->byVariableOffset &&
+          header->byVariableOffset + records * 4 <= size)) {
+      return false;
+    }
+
+    // The strings end in a NUL, so every offset into them is terminated
+    uint32_t stringsSize = header->recordsOffset - header->stringsOffset;
+    if (header->numStrings && (!stringsSize || s[header->recordsOffset - 1])) {
+      return false;
+    }
+    const uint32_t *offsets = reinterpret_cast<const uint32_t *>(s + sizeof(SegmentHeader));
+    for (uint32_t i = 0; i < header->numStrings; i++) {
+      if (offsets[i] >= stringsSize) {
+        return false;
+      }
+    }
+    const Record *r = reinterpret_cast<const Record *>(s + header->recordsOffset);
+    for (uint32_t i = 0; i < records; i++) {
+      if (r[i].function >= header->numStrings || r[i].file >= header->numStrings ||
+          r[i].variable >= header->numStrings) {
+        return false;
+      }
+    }
+    for (uint32_t offset : {header->byFunctionOffset, header->byFileOffset,
+                            header->byVariableOffset}) {
+      const uint32_t *index = reinterpret_cast<const uint32_t *>(s + offset);
+      for (uint32_t i = 0; i < records; i++) {
+        if (index[i] >= records) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  void *base = nullptr;
+  size_t size = 0;
+};
+
+} // namespace results
+
+#endif // RESULTS_STORE_H
@@ -0,0 +1,3 @@
+#!/bin/bash
+# Build the query tool. The passes include ResultsStore.h through setup.sh.
+g++ -O2 -std=c++17 -o results_query results_query.cpp
@@ -0,0 +1,155 @@
+// Query the results store written by -taint-results and -undeclvar-results.
+//
+// Usage: results_query <store> function|file|variable <name> [kind]
+//        results_query <store> dump [kind]
+//        results_query <store> stats
+//        results_query <store> compact
+//   kind  tainted, sink, call, undef or analyzed
+// For example, the functions in which tainted values reach system():
+//   results_query results.db variable system call
+//
+// Lookups run on the mapped file: a binary search for the name and one for
+// its range in the index of every segment. Records of a function analyzed
+// again by a newer run are skipped. compact rewrites the store as one segment
+// without them and without duplicates, which keeps lookups at one search per
+// index.
+
+#include "ResultsStore.h"
+
+#include <chrono>
+#include <cstdio>
+#include <set>
+
+using namespace results;
+using namespace std;
+
+static int kindFromName(const char *name) {
+  for (uint32_t kind = 0; kind < NumKinds; kind++) {
+    if (!strcmp(kindName(kind), name)) {
+      return kind;
+    }
+  }
+  fprintf(stderr, "unknown kind %s\n", name);
+  exit(1);
+}
+
+// "kind <TAB> function <TAB> file:line <TAB> variable"
+static string format(const Segment &segment, const Record &r) {
+  return string(kindName(r.kind)) + "\t" + segment.string(r.function) + "\t" +
+         segment.string(r.file) + ":" + to_string(r.line) + "\t" +
+         segment.string(r.variable);
+}
+
+static int compact(const string &path, Reader &reader) {
+  Writer writer;
+  for (size_t s = 0; s < reader.segments.size(); s++) {
+    const Segment &segment = reader.segments[s];
+    for (uint32_t i = 0; i < segment.header->numRecords; i++) {
+      const Record &r = segment.records[i];
+      if (reader.superseded(s, r)) {
+        continue;
+      }
+      writer.add(RecordKind(r.kind), segment.string(r.function), segment.string(r.file),
+                 r.line, segment.string(r.variable));
+    }
+  }
+
+  // Writers block on the lock and append to the new file after the rename
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0 || flock(fd, LOCK_EX)) {
+    perror(path.c_str());
+    return 1;
+  }
+  Reader locked;
+  string error;
+  if (!locked.open(path, error) || locked.segments.size() != reader.segments.size()) {
+    fprintf(stderr, "%s changed while compacting, try again\n", path.c_str());
+    return 1;
+  }
+
+  string tmp = path + ".compact";
+  unlink(tmp.c_str());
+  if (!writer.append(tmp, error) || rename(tmp.c_str(), path.c_str())) {
+    fprintf(stderr, "%s: %s\n", tmp.c_str(), error.empty() ? strerror(errno) : error.c_str());
+    return 1;
+  }
+  close(fd);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <store> function|file|variable <name> [kind]\n"
+                    "       %s <store> dump [kind] | stats | compact\n",
+            argv[0], argv[0]);
+    return 1;
+  }
+  string path = argv[1], command = argv[2];
+
+  auto start = chrono::steady_clock::now();
+  Reader reader;
+  string error;
+  if (!reader.open(path, error)) {
+    fprintf(stderr, "%s: %s\n", path.c_str(), error.c_str());
+    return 1;
+  }
+
+  if (command == "compact") {
+    return compact(path, reader);
+  }
+
+  if (command == "stats") {
+    uint64_t records = 0, strings = 0, bytes = 0;
+    for (const Segment &segment : reader.segments) {
+      records += segment.header->numRecords;
+      strings += segment.header->numStrings;
+      bytes += segment.header->size;
+    }
+    printf("%zu segments, %lu records, %lu strings, %lu bytes\n",
+           reader.segments.size(), records, strings, bytes);
+    return 0;
+  }
+
+  // Segments may repeat results of the same function, print each line once
+  set<string> lines;
+  if (command == "dump") {
+    int kind = argc > 3 ? kindFromName(argv[3]) : -1;
+    for (size_t s = 0; s < reader.segments.size(); s++) {
+      const Segment &segment = reader.segments[s];
+      for (uint32_t i = 0; i < segment.header->numRecords; i++) {
+        if ((kind < 0 || segment.records[i].kind == uint32_t(kind)) &&
+            !reader.superseded(s, segment.records[i])) {
+          lines.insert(format(segment, segment.records[i]));
+        }
+      }
+    }
+  } else if (argc > 3 && (command == "function" || command == "file" || command == "variable")) {
+    int kind = argc > 4 ? kindFromName(argv[4]) : -1;
+    for (size_t s = 0; s < reader.segments.size(); s++) {
+      const Segment &segment = reader.segments[s];
+      int64_t id = segment.find(argv[3]);
+      if (id < 0) {
+        continue;
+      }
+      auto range = command == "function" ? segment.range(segment.byFunction, &Record::function, id)
+                   : command == "file"   ? segment.range(segment.byFile, &Record::file, id)
+                                         : segment.range(segment.byVariable, &Record::variable, id);
+      for (const uint32_t *r = range.first; r != range.second; ++r) {
+        if ((kind < 0 || segment.records[*r].kind == uint32_t(kind)) &&
+            !reader.superseded(s, segment.records[*r])) {
+          lines.insert(format(segment, segment.records[*r]));
+        }
+      }
+    }
+  } else {
+    fprintf(stderr, "unknown command %s\n", command.c_str());
+    return 1;
+  }
+
+  auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+  for (const string &line : lines) {
+    printf("%s\n", line.c_str());
+  }
+  fprintf(stderr, "%zu results in %ld us\n", lines.size(), (long)elapsed.count());
+  return 0;
+}
@@ -0,0 +1,19 @@
+#!/bin/bash
+# Analyze C/C++ files in parallel into one results store, then compact it.
+# Every function of the files is analyzed, and running again on changed files
+# replaces their earlier results.
+# Usage: ./run.sh <store> <source files>...
+#   ./results_query <store> variable system call
+store=$1
+shift
+for src in "$@"; do
+  (
+    ll="${src%.*}.ll"
+    clang++ -O0 -g -S -emit-llvm -fno-discard-value-names -o "$ll" -c "$src"
+    opt -enable-new-pm=0 -load ~/llvm-project/build/lib/Assignment1.so -undeclvar -undeclvar-results="$store" -disable-output "$ll" 2> /dev/null
+    opt -enable-new-pm=0 -load ~/llvm-project/build/lib/Assignment2.so -taintanalysis -taint-results="$store" -disable-output "$ll" 2> /dev/null
+  ) &
+done
+wait
+./results_query "$store" compact
+./results_query "$store" stats
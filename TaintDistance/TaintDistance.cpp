@@ -0,0 +1,322 @@
+// Directed fuzzing distance instrumentation (AFLGo style).
+//
+// Reads the input dependent sites exported by taintanalysis (-taint-directed
+// -taint-sinks) and computes for every basic block its distance to them:
+//   - function level: harmonic mean of call graph distances to the functions
+//     that contain a target,
+//   - block level: harmonic mean over the targets and the calls into functions
+//     with a distance, of CFG hops plus 10 x the callee's function distance.
+// Every block with a distance then adds it (x100) to the 64-bit sum at
+// __afl_area_ptr[MAP_SIZE] and increments the count at [MAP_SIZE + 8], which
+// is the layout AFLGo's afl-fuzz reads for its annealing power schedule.
+
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cxxabi.h>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace llvm;
+using namespace std;
+
+// Strings for output
+std::string output_str;
+raw_string_ostream output(output_str);
+
+static cl::opt<string> TargetsFile("taint-targets", cl::init(""),
+                                   cl::desc("Sites written by -taint-sinks"));
+
+static cl::opt<string> DistanceFile("taint-distance", cl::init(""),
+                                    cl::desc("Also write block distances here"));
+
+// Must match MAP_SIZE of the afl-fuzz the target runs under.
+static cl::opt<unsigned> MapSize("taint-map-size", cl::init(1 << 16),
+                                 cl::desc("Coverage map size of afl-fuzz"));
+
+// Weight of a call into a function relative to one CFG hop, as in AFLGo.
+static const double CallWeight = 10.0;
+
+namespace {
+class TaintDistance : public ModulePass {
+public:
+  static char ID;
+
+  TaintDistance() : ModulePass(ID) {}
+
+  bool runOnModule(Module &M) override {
+    if (!readTargets()) {
+      return false;
+    }
+
+    findTargetBBs(M);
+    computeFunctionDistances(M);
+    for (Function &F : M) {
+      if (!F.isDeclaration()) {
+        computeBBDistances(F);
+      }
+    }
+
+    if (!DistanceFile.empty()) {
+      writeDistances(M);
+    }
+    int instrumented = instrument(M);
+
+    output << "Targets: " << targetBBs.size() << " blocks in "
+           << targetFuncs.size() << " functions, " << instrumented
+           << " blocks instrumented\n";
+    errs() << output.str();
+    output.flush();
+
+    cleanGlobalVariables();
+    return instrumented > 0;
+  }
+
+private:
+  // "file:line" of every target site, file reduced to its base name
+  unordered_set<string> targets;
+  unordered_set<BasicBlock *> targetBBs;
+  unordered_set<Function *> targetFuncs;
+  unordered_map<Function *, double> funcDistance;
+  unordered_map<BasicBlock *, double> bbDistance;
+
+  bool readTargets() {
+    auto buffer = MemoryBuffer::getFile(TargetsFile);
+    if (!buffer) {
+      errs() << "Cannot read targets file '" << TargetsFile << "'\n";
+      return false;
+    }
+
+    SmallVector<StringRef, 32> lines;
+    (*buffer)->getBuffer().split(lines, '\n', -1, false);
+    for (StringRef line : lines) {
+      StringRef site = line.split(' ').first.trim();
+      StringRef file = site.rsplit(':').first;
+      StringRef lineNo = site.rsplit(':').second;
+      if (!file.empty() && !lineNo.empty()) {
+        targets.insert(sys::path::filename(file).str() + ":" + lineNo.str());
+      }
+    }
+    return !targets.empty();
+  }
+
+  string getLocation(Instruction *I) {
+    DILocation *loc = I->getDebugLoc();
+    if (!loc) {
+      return "";
+    }
+    return sys::path::filename(loc->getFilename()).str() + ":" +
+           to_string(loc->getLine());
+  }
+
+  void findTargetBBs(Module &M) {
+    for (Function &F : M) {
+      for (BasicBlock &b : F) {
+        for (Instruction &I : b) {
+          if (targets.count(getLocation(&I))) {
+            targetBBs.insert(&b);
+            targetFuncs.insert(&F);
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  Function *getCallee(Instruction *I) {
+    if (CallBase *call = dyn_cast<CallBase>(I)) {
+      Function *callee = call->getCalledFunction();
+      if (callee && !callee->isDeclaration()) {
+        return callee;
+      }
+    }
+    return nullptr;
+  }
+
+  // Harmonic mean of the distances, 0 if any of them is 0.
+  static double harmonicMean(const vector<double> &distances) {
+    double sum = 0;
+    for (double d : distances) {
+      if (d == 0) {
+        return 0;
+      }
+      sum += 1.0 / d;
+    }
+    return distances.size() / sum;
+  }
+
+  void computeFunctionDistances(Module &M) {
+    // Reverse call graph: callee -> callers
+    unordered_map<Function *, unordered_set<Function *>> callers;
+    for (Function &F : M) {
+      for (Instruction &I : instructions(F)) {
+        if (Function *callee = getCallee(&I)) {
+          callers[callee].insert(&F);
+        }
+      }
+    }
+
+    unordered_map<Function *, vector<double>> distances;
+    for (Function *target : targetFuncs) {
+      // Breadth-first search towards the callers of the target
+      unordered_map<Function *, unsigned> hops;
+      queue<Function *> worklist;
+      hops[target] = 0;
+      worklist.push(target);
+      while (!worklist.empty()) {
+        Function *f = worklist.front();
+        worklist.pop();
+        for (Function *caller : callers[f]) {
+          if (!hops.count(caller)) {
+            hops[caller] = hops[f] + 1;
+            worklist.push(caller);
+          }
+        }
+      }
+      for (auto &entry : hops) {
+        distances[entry.first].push_back(entry.second);
+      }
+    }
+
+    for (auto &entry : distances) {
+      funcDistance[entry.first] = harmonicMean(entry.second);
+    }
+  }
+
+  void computeBBDistances(Function &F) {
+    // Blocks the distance is measured to, with their own distance
+    unordered_map<BasicBlock *, double> seeds;
+    for (BasicBlock &b : F) {
+      if (targetBBs.count(&b)) {
+        seeds[&b] = 0;
+        continue;
+      }
+      for (Instruction &I : b) {
+        Function *callee = getCallee(&I);
+        if (callee && funcDistance.count(callee)) {
+          double d = CallWeight * funcDistance[callee];
+          if (!seeds.count(&b) || d < seeds[&b]) {
+            seeds[&b] = d;
+          }
+        }
+      }
+    }
+
+    unordered_map<BasicBlock *, vector<double>> distances;
+    for (auto &seed : seeds) {
+      // Breadth-first search towards the predecessors of the seed
+      unordered_map<BasicBlock *, unsigned> hops;
+      queue<BasicBlock *> worklist;
+      hops[seed.first] = 0;
+      worklist.push(seed.first);
+      while (!worklist.empty()) {
+        BasicBlock *b = worklist.front();
+        worklist.pop();
+        for (BasicBlock *pred : predecessors(b)) {
+          if (!hops.count(pred)) {
+            hops[pred] = hops[b] + 1;
+            worklist.push(pred);
+          }
+        }
+      }
+      for (auto &entry : hops) {
+        distances[entry.first].push_back(entry.second + seed.second);
+      }
+    }
+
+    for (auto &entry : distances) {
+      bbDistance[entry.first] = harmonicMean(entry.second);
+    }
+  }
+
+  // Same format as AFLGo's distance.cfg.txt: "file:line,distance" keyed by
+  // the first located instruction of the block.
+  void writeDistances(Module &M) {
+    std::error_code EC;
+    raw_fd_ostream file(DistanceFile, EC, sys::fs::OF_Text);
+    if (EC) {
+      errs() << "Cannot write " << DistanceFile << ": " << EC.message() << "\n";
+      return;
+    }
+    for (Function &F : M) {
+      for (BasicBlock &b : F) {
+        if (!bbDistance.count(&b)) {
+          continue;
+        }
+        for (Instruction &I : b) {
+          string location = getLocation(&I);
+          if (!location.empty()) {
+            file << location << "," << (uint64_t)(bbDistance[&b] * 100) << "\n";
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  int instrument(Module &M) {
+    LLVMContext &C = M.getContext();
+    Type *int8PtrTy = Type::getInt8PtrTy(C);
+    Type *int64Ty = Type::getInt64Ty(C);
+    GlobalVariable *areaPtr = M.getGlobalVariable("__afl_area_ptr");
+    if (!areaPtr) {
+      areaPtr = new GlobalVariable(M, int8PtrTy, false,
+                                   GlobalValue::ExternalLinkage, nullptr,
+                                   "__afl_area_ptr");
+    }
+
+    int instrumented = 0;
+    for (auto &entry : bbDistance) {
+      BasicBlock *b = entry.first;
+      uint64_t distance = (uint64_t)(entry.second * 100);
+
+      IRBuilder<> builder(&*b->getFirstInsertionPt());
+      Value *area = builder.CreateLoad(int8PtrTy, areaPtr, "afl.area");
+      Value *sumPtr = builder.CreateBitCast(
+          builder.CreateConstInBoundsGEP1_64(builder.getInt8Ty(), area, MapSize),
+          int64Ty->getPointerTo());
+      Value *cntPtr = builder.CreateBitCast(
+          builder.CreateConstInBoundsGEP1_64(builder.getInt8Ty(), area, MapSize + 8),
+          int64Ty->getPointerTo());
+
+      Value *sum = builder.CreateLoad(int64Ty, sumPtr);
+      builder.CreateStore(builder.CreateAdd(sum, builder.getInt64(distance)), sumPtr);
+      Value *cnt = builder.CreateLoad(int64Ty, cntPtr);
+      builder.CreateStore(builder.CreateAdd(cnt, builder.getInt64(1)), cntPtr);
+      instrumented++;
+    }
+    return instrumented;
+  }
+
+  // Reset all global variables when a new module is run.
+  void cleanGlobalVariables() {
+    targets.clear();
+    targetBBs.clear();
+    targetFuncs.clear();
+    funcDistance.clear();
+    bbDistance.clear();
+    output_str = "";
+  }
+
+}; // TaintDistance
+} // namespace
+
+char TaintDistance::ID = 0;
+static RegisterPass<TaintDistance> X("taintdistance",
+                                     "Pass to instrument distance to tainted sites");
@@ -0,0 +1,13 @@
+#!/bin/bash
+# Build a fuzz target whose blocks report their distance to the input
+# dependent sites of one function, then fuzz it with AFLGo's schedule.
+# Usage: ./run.sh <target .c> <entry function> <input dir>
+# AFLGO must point at an AFLGo checkout.
+name=$(basename "$1" .c)
+clang -O0 -g -S -emit-llvm -fno-discard-value-names -o "$name.ll" -c "$1"
+opt -enable-new-pm=0 -load ~/llvm-project/build/lib/Assignment2.so -taintanalysis -taint-directed -taint-entry="$2" -taint-sinks="$name.targets" < "$name.ll" > /dev/null
+opt -enable-new-pm=0 -load ~/llvm-project/build/lib/TaintDistance.so -taintdistance -taint-targets="$name.targets" -taint-distance="$name.distance" < "$name.ll" > "$name.bc"
+
+# AFLGo's compiler adds the edge coverage, its afl-fuzz reads the distance
+"$AFLGO/afl-clang-fast" "$name.bc" -o "$name"
+"$AFLGO/afl-fuzz" -z exp -c 45m -i "$3" -o "output_$name" -m none -- "./$name" @@